@@ -1,11 +1,13 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "del/formula.hpp"
 #include "del/types.hpp"
 
 #include "del/util/bitset.hpp"
+#include "del/util/bitset_array.hpp"
 
 
 namespace del
@@ -15,6 +17,7 @@ namespace del
 		Q: A -> (E*E -> L_epis)
 		Pre: E -> L_epis
 		Post E -> (P -> {true, false, inert})
+			Postconditions on attention propositions are kept apart, as attention matrices, matching the valuations of states (see attention.hpp).
 	*/
 	class action {
 		friend class domain; // For creating actions.
@@ -26,8 +29,18 @@ namespace del
 				- All preconditions are TOP.
 				- All postcondiitons are no change.
 				- No accessibility between events.
+			The formulas of the action are built in pool, shared with other actions and queries (see domain::get_formulas), or in a pool of its own if none is given.
 		*/
-		action(size_type num_agents, size_type num_events, util::bitset<>::common_state proposition_bitset_state);
+		action(size_type num_agents, size_type num_events, util::bitset<>::common_state proposition_bitset_state, std::shared_ptr<formula> pool = nullptr);
+
+		/*
+			Construct a factored action model for an ontic change of the touched propositions (add set to true, del set to false), where:
+				- Each touched proposition t has, per agent, a condition under which the agent observes the change of t; by default BOT.
+				- The events are implicit: one per subset S of the touched propositions, applying exactly the changes in S, with precondition TOP.
+				- The designated event is the full set; from it an agent accesses the event of the touched propositions it observes, from any other event only that event itself.
+			The product update expands only the (world, subset) combinations which are reachable, instead of all 2^|touched| events.
+		*/
+		action(size_type num_agents, std::vector<proposition_id> const & add, std::vector<proposition_id> const & del, util::bitset<>::common_state proposition_bitset_state, std::shared_ptr<formula> pool = nullptr);
 
 		// Need any of these?
 		action(action const &) = delete; // deletes the copy constructor
@@ -37,26 +50,57 @@ namespace del
 
 	private:
 		size_type num_events;
+		bool factored;
 
-		// Stores all formulas that the action uses, the internal structures just point to formula nodes in this collection.
+		// Stores all formulas that the action uses, the internal structures just point to formula nodes in this collection; possibly shared with other actions. Built simplifying, so trivial conditions fold to TOP or BOT.
 		// NB! Q and pre uses formulas in member initialization, so declaration order is important.
-		formula formulas;
+		std::shared_ptr<formula> formulas;
+
+		// Condition of every event pair not stored in Q.
+		formula::node_id bot;
+
+		struct accessible_event
+		{
+			event_id event;
+			formula::node_id condition;
+		};
 
 		// TODO: Please end this std::vector hell for storing collections which are static after construction.
 		// Q tracks how different agents perceive the relations between different events, which is key to modeling knowledge updates and belief changes in multi-agent systems.
-		std::vector<formula::node_id> Q; // (A x E x E) -> phi 
+		// Stored sparsely: only the pairs which have been given a condition other than BOT are listed, all others are BOT.
+		std::vector<std::vector<accessible_event>> Q; // (A x E) -> [(E, phi)]
 		std::vector<formula::node_id> pre;
-		std::vector<util::bitset<>> post_add;
-		std::vector<util::bitset<>> post_del;
+		util::bitset_array<> post_add; // E -> 2^P
+		util::bitset_array<> post_del; // E -> 2^P
+		util::bitset<>::common_state Acs; // Of attention matrices; NB! declared before the attention postconditions using it.
+		util::bitset_array<> attention_add; // E -> 2^(A x P), over Acs.
+		util::bitset_array<> attention_del; // E -> 2^(A x P), over Acs.
+
+		// Factored representation, only used if factored is set.
+		struct touched_proposition
+		{
+			proposition_id prop;
+			bool value;
+		};
+
+		std::vector<touched_proposition> touched;
+		std::vector<formula::node_id> observes; // (A x touched) -> phi
 
 		void set_pre(event_id e, formula::node_id f);
 		formula::node_id get_pre(event_id e) const;
 
 		void set_post(event_id e, proposition_id p, bool v, util::bitset<>::common_state proposition_bitset_state);
-		util::bitset<> const & get_post_del(event_id e) const;
-		util::bitset<> const & get_post_add(event_id e) const;
+		util::bitset_array<>::const_span get_post_del(event_id e, util::bitset<>::common_state proposition_bitset_state) const;
+		util::bitset_array<>::const_span get_post_add(event_id e, util::bitset<>::common_state proposition_bitset_state) const;
+		util::bitset_array<>::const_span get_attention_del(event_id e) const;
+		util::bitset_array<>::const_span get_attention_add(event_id e) const;
 
 		void set_accessible(agent_id a, event_id e1, event_id e2, formula::node_id f);
 		formula::node_id get_accessible(agent_id a, event_id e1, event_id e2) const;
+		std::vector<accessible_event> const & get_accessible_events(agent_id a, event_id e) const;
+
+		size_type get_num_touched() const;
+		void set_observes(agent_id a, size_type t, formula::node_id f);
+		formula::node_id get_observes(agent_id a, size_type t) const;
 	};
 }
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <utility>
+
+#include "del/types.hpp"
+
+#include "del/util/bitset.hpp"
+
+
+namespace del
+{
+	/*
+		Attention propositions are numbered after the P base propositions, agent by agent: agent a paying attention to base proposition p is P + a * P + p.
+		Valuations only hold the base propositions. The attention propositions of a world form an A x P matrix of its own, one row of base propositions per agent (see state).
+		P is the size of the proposition_bitset_state of the domain.
+	*/
+	inline bool is_attention_proposition(proposition_id p, util::bitset<>::common_state proposition_bitset_state)
+	{
+		return p.id >= proposition_bitset_state.get_size();
+	}
+
+	inline std::pair<agent_id, proposition_id> split_attention_proposition(proposition_id p, util::bitset<>::common_state proposition_bitset_state)
+	{
+		size_type num_base = static_cast<size_type>(proposition_bitset_state.get_size());
+		return { agent_id{ (p.id - num_base) / num_base }, proposition_id{ (p.id - num_base) % num_base } };
+	}
+
+	inline proposition_id get_attention_proposition(agent_id a, proposition_id p, util::bitset<>::common_state proposition_bitset_state)
+	{
+		size_type num_base = static_cast<size_type>(proposition_bitset_state.get_size());
+		return proposition_id{ num_base + a.id * num_base + p.id };
+	}
+
+	// Common state of attention matrices, stored as one bitset with block aligned rows.
+	inline util::bitset<>::common_state get_attention_bitset_state(size_type num_agents, util::bitset<>::common_state proposition_bitset_state)
+	{
+		return proposition_bitset_state.get_rows_state(num_agents);
+	}
+
+	// Bit of agent a paying attention to base proposition p in an attention matrix.
+	inline std::size_t get_attention_bit(agent_id a, proposition_id p, util::bitset<>::common_state proposition_bitset_state)
+	{
+		return a.id * proposition_bitset_state.get_aligned_size() + p.id;
+	}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -8,6 +9,7 @@
 #include "del/formula.hpp"
 #include "del/state.hpp"
 #include "del/types.hpp"
+#include "del/workspace.hpp"
 
 #include "del/util/bitset.hpp"
 
@@ -18,7 +20,11 @@ namespace del
 {
 	class domain {
 	public:
-		domain(std::vector<std::string> const & agents, std::vector<std::string> const & propositions, std::vector<bool> const & default_values);
+		/*
+			With lazy_attention_propositions, the A x P attention propositions get no names, map entries or default values up front: their ids are computed (see attention.hpp),
+			and the name of one is only built and registered when first asked for, by get_proposition_name or get_proposition_id. Their default value is true either way.
+		*/
+		domain(std::vector<std::string> const & agents, std::vector<std::string> const & propositions, std::vector<bool> const & default_values, bool lazy_attention_propositions = false);
 
 		// Should not need these, but maybe for convenience of library consumers?
 		domain(domain const &) = delete;
@@ -26,16 +32,32 @@ namespace del
 		domain(domain &&) = delete;
 		domain & operator=(domain &&) = delete;
 
+		// Bisimulation contraction of every state produced by a product update; enabled by default.
+		void set_bisimulation_contraction(bool enabled);
+
+		// Transposed valuations (one world set per proposition) for initial states added afterwards, and so for all states updated from them; enabled by default.
+		void set_transposed_valuations(bool enabled);
+
+		// Delta valuations (see state::enable_delta_valuations) for initial states added afterwards, saving the memory of the valuations of all but the latest states; disabled by default.
+		void set_delta_valuations(bool enabled);
+
+		// Caching, per state, of the results of up to capacity formulas of get_formulas evaluated by evaluate_formula, the oldest evicted first (see state::evaluate_cached); 0, the default, disables it.
+		void set_formula_cache(std::size_t capacity);
+
 		size_type get_num_agents() const;
 		agent_id get_agent_id(std::string const & name) const;
 		std::string const & get_agent_name(agent_id id) const;
 		
 		size_type get_num_propositions() const;
+		// Common state of valuations, over the base propositions only; attention propositions are stored apart (see attention.hpp). For state and formula functions taking a proposition_bitset_state.
+		util::bitset<>::common_state get_proposition_bitset_state() const;
 		proposition_id get_proposition_id(std::string const & name) const;
 		std::string const & get_proposition_name(proposition_id id) const;
 
+		// The base proposition named a1_sees_a2, interned by the constructor; throws std::out_of_range if the domain has none.
 		proposition_id get_sees_proposition_id(agent_id a1, agent_id a2) const;
 
+		// Computed from the ids, without name lookups (see attention.hpp).
 		proposition_id get_attention_proposition_id(agent_id a, proposition_id p) const;
 
 		std::vector<proposition_id> get_domain_non_attention_propositions_id() const;
@@ -66,12 +88,21 @@ namespace del
 		//std::pair<action_id, state_id> perform_oc(std::vector<std::pair<agent_id, agent_id>> add, std::vector<std::pair<agent_id, agent_id>> del);
 
 		bool evaluate_formula(state_id s, formula const & f, formula::node_id n) const;
+		// Of a formula built in the pool of the domain (see get_formulas).
+		bool evaluate_formula(state_id s, formula::node_id n) const;
+
+		/*
+			Append-only pool of formulas, shared by all actions of the domain and open to queries, so that equal subformulas have one node_id across all of them (see formula).
+			Built simplifying; node_ids stay valid for the lifetime of the domain.
+		*/
+		formula & get_formulas();
+		formula const & get_formulas() const;
 
 		void print_state_overview(state const & s, std::vector<proposition_id> propositions) const ; 
 
 		void others_agents_belief_regarding_attention(state_id s, agent_id a) const ; 
 
-		// Retrieve agent and proposition from attention proposition
+		// Retrieve agent and proposition from attention proposition; the inverse of get_attention_proposition_id. Throws std::invalid_argument for other propositions.
 		std::pair<agent_id, proposition_id> get_agent_and_proposition(proposition_id attention_prop) const ;
 
 		bool get_proposition_default_value(proposition_id p) const ;
@@ -79,7 +110,7 @@ namespace del
 		size_type num_agents;
 		size_type num_propositions;
 		size_type num_non_attention_propositions;
-		util::bitset<>::common_state proposition_bitset_state; //efficient way to store the blocks and bits size of each propositions bitset
+		util::bitset<>::common_state proposition_bitset_state; //efficient way to store the blocks and bits size of each propositions bitset; over the non attention propositions
 
 		std::vector<state> states;
 		std::vector<action> actions;
@@ -88,10 +119,23 @@ namespace del
 		std::unordered_map<std::string, agent_id> agent_name_to_id;
 		std::vector<std::string> propositions;
 		std::vector<bool> propositions_default;
-		std::unordered_map<std::string, proposition_id> prop_name_to_id;
+		mutable std::unordered_map<std::string, proposition_id> prop_name_to_id; // Mutable, as lazy attention propositions are registered on lookup.
+
+		bool lazy_attention_propositions;
+		mutable std::unordered_map<size_type, std::string> attention_proposition_names; // Lazy attention propositions named so far; a map, as get_proposition_name hands out references.
+		std::vector<proposition_id> sees_propositions; // A x A, by (a1, a2); -1 where the domain has no a1_sees_a2 proposition.
+
+		std::shared_ptr<formula> formula_pool; // Shared with the actions; grown only by non-const members, and by callers through the non-const get_formulas.
+
+		bool bisimulation_contraction;
+		bool transposed_valuations;
+		bool delta_valuations;
+		std::size_t formula_cache_capacity;
+		mutable workspace working_memory; // For all updates and evaluations; mutable, as const evaluations use it too.
 
 		std::string get_sees_proposition_name(agent_id a1, agent_id a2) const;
 		std::string get_attention_proposition_name(agent_id a, proposition_id p) const;
+		std::string const & register_attention_proposition(proposition_id p) const;
 	
 
 		std::vector<proposition_id> get_remaining_non_attention_propositions(std::vector<proposition_id> const propositions, std::vector<proposition_id> const propositions_set) const;
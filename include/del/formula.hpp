@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "del/types.hpp"
+#include "del/workspace.hpp"
 
 #include "del/util/bitset.hpp"
 
@@ -15,9 +18,9 @@ namespace del
 
 	/*
 		L_epis:
-			phi ::= p | !p | phi ^ phi | B_i phi | C_B phi
+			phi ::= p | !p | phi ^ phi | B_i phi | C_B phi | A_i p
 
-		ATTENTION IMPLEMENTATION: Attention as logical formula will have to be added here 
+		A_i p holds if agent i pays attention to the base proposition p; it is equivalent to the attention proposition of (i, p), but names the agent and proposition directly (see attention.hpp).
 		TODO: More efficient representation? We can encode TOP, BOT, and PROP as implicit indices (assuming formula associated with a static domain for PROP).
 	*/
 
@@ -27,6 +30,7 @@ namespace del
 
 		-Tautologies or contradictions
 		-Propositions (basic logical statements).
+		-Attention of an agent to a proposition.
 		-Logical operators like negation (NOT), conjunction (AND), or disjunction (OR).
 		-Belief operators (e.g., B_i, where agent i believes a formula).
 		-Group belief operators like common belief (C_B).
@@ -40,7 +44,16 @@ namespace del
 			size_type id;
 		};
 
+		// Worlds of a state satisfying a formula (see evaluate_all); kept inline for states of up to 128 worlds, so most evaluations allocate no sets.
+		using world_set = util::bitset<std::size_t, 2>;
+
 		formula() = default;
+		/*
+			With simplify, the builders fold constants as they go: TOP and BOT operands are absorbed or decide the node, nested AND/OR are flattened into their parent,
+			duplicate operands dropped, one-operand AND/OR replaced by the operand, double negations cancelled, and modal operators of TOP made TOP.
+			The node returned may then not be of the kind built, e.g. new_and of nothing is TOP.
+		*/
+		explicit formula(bool simplify);
 
 		// Need any of these?
 		formula(formula const &) = delete;
@@ -52,6 +65,7 @@ namespace del
 		node_id new_top();
 		node_id new_bot();
 		node_id new_prop(proposition_id p);
+		node_id new_attention(agent_id a, proposition_id p);
 		node_id new_not(node_id f);
 		node_id new_and(std::vector<node_id> conjuncts);
 		node_id new_or(std::vector<node_id> disjuncts);
@@ -59,9 +73,22 @@ namespace del
 		node_id new_everyone_believes(std::vector<agent_id> const & as, size_type order, node_id f);
 		node_id new_common_belief(std::vector<agent_id> const & as, node_id f);
 
+		/*
+			Whether n holds at w. n is compiled on first use (see compile), and then interpreted without recursing into its propositional structure.
+			The overload without a workspace builds one per call, for convenience and debugging; repeated evaluations pass a workspace kept across them, e.g. that of the domain.
+		*/
 		bool evaluate(state const & s, world_id w, node_id n, util::bitset<>::common_state proposition_bitset_state) const;
+		bool evaluate(state const & s, world_id w, node_id n, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const;
+
+		// The set of worlds of s satisfying n, over s.get_worlds_bitset_state(). Computed bottom-up with bitset operations rather than per world.
+		world_set evaluate_all(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state) const;
+		// As above, keeping the world set of n and of each of its subformulas in sets, by node id; subformulas shared by the formulas evaluated on s with the same sets are evaluated once.
+		world_set const & evaluate_all(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state, std::unordered_map<size_type, world_set> & sets) const;
 
 		bool isNull(node_id n) const;
+		// Whether n is the constant TOP or BOT, e.g. after folding with simplify.
+		bool is_top(node_id n) const;
+		bool is_bot(node_id n) const;
 		// TODO: Only for debugging.
 		std::string to_string(domain const & d, node_id n) const;
 
@@ -71,6 +98,7 @@ namespace del
 			TOP, //tautology— a formula that is always true
 			BOT, //contradiction— a formula that is always false
 			PROP,
+			ATTENTION,
 			NOT,
 			AND,
 			OR,
@@ -97,5 +125,59 @@ namespace del
 		};
 
 		std::vector<node> nodes;
+		bool simplify = false;
+
+		// The operands of the AND (or OR) to build from operands, with nested nodes of that kind flattened, duplicates dropped, and the constant absorbed by it dropped.
+		// Returns false if one of them is the constant deciding the node.
+		bool collect_operands(formula_type type, std::vector<node_id> const & operands, std::vector<node_id> & collected) const;
+
+		// Nodes are hash-consed: a node equal to an existing one is not stored again, so identical subformulas share one node_id. Hash of the cells of each node -> its id.
+		std::unordered_multimap<std::size_t, size_type> node_index;
+
+		// Number of cells the node n takes up in nodes.
+		size_type get_node_size(node_id n) const;
+		// Looks up the node just appended at first; if it already exists, the new copy is dropped and the existing one returned.
+		node_id intern(size_type first);
+
+		/*
+			Compiled formulas, for evaluate: a formula is a segment of program, its nodes in postorder, computing its truth value on a stack of values (see workspace::values) and ending in RETURN.
+			Conjunctions and disjunctions jump past their remaining operands as soon as the value on top of the stack decides them.
+			The operands of the modal operators are segments of their own, run once per world they are evaluated at; they are shared, as segments are compiled once per node.
+		*/
+		enum class opcode : size_type
+		{
+			TOP,
+			BOT,
+			PROP, // a: proposition.
+			ATTENTION, // a: agent, b: base proposition.
+			NOT,
+			JUMP_IF_FALSE, // a: target; pops the top value unless jumping.
+			JUMP_IF_TRUE, // a: target; pops the top value unless jumping.
+			BELIEVES, // a: agent, b: segment of the operand.
+			EVERYONE_BELIEVES, // a: the node, for its group and order, b: segment of the operand.
+			COMMON_BELIEF, // a: the node, for its group, b: segment of the operand.
+			RETURN
+		};
+
+		struct instruction
+		{
+			opcode op;
+			size_type a;
+			size_type b;
+		};
+
+		mutable std::vector<instruction> program; // Mutable, as formulas are compiled on first evaluation.
+		mutable std::unordered_map<size_type, size_type> segment; // Node -> start of its segment of program.
+
+		// Start of the segment of n, compiling it (and the operands of its modal operators) if this is the first time.
+		size_type compile(node_id n) const;
+		void compile_operands(node_id n) const;
+		void emit(node_id n) const;
+		bool run(size_type start, state const & s, world_id w, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const;
+
+		world_set evaluate_all_node(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state, std::unordered_map<size_type, world_set> & sets) const;
+
+		// The agents stored in the count nodes starting at first, as a group for state::get_group_relation (sorted, without duplicates).
+		void get_group(size_type first, size_type count, std::vector<size_type> & group) const;
 	};
 }
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
+#include "del/formula.hpp"
 #include "del/types.hpp"
+#include "del/workspace.hpp"
 
+#include "del/util/bit_matrix.hpp"
 #include "del/util/bitset.hpp"
+#include "del/util/bitset_vector.hpp"
 
 
 namespace del
@@ -15,6 +24,8 @@ namespace del
 		W
 		R: A -> 2^(W*W) The accessibility relation represents what worlds are possible from the perspective of an agent.
 		V: P -> 2^W (equivalently W -> 2^P) The valuation function specifies which propositions are true in each world. It tells us, for a given world w, what atomic propositions hold.
+			Worlds often share valuations, e.g. copies of a world which only differ in what agents believe, so each distinct valuation is stored once and V maps worlds to it.
+		VA: W -> 2^(A*P) The attention of each agent to each base proposition, stored apart from V in the same way.
 		S: A*A -> 2^W 
 	*/
 	class state {
@@ -30,32 +41,202 @@ namespace del
 		state(state &&) = default;
 		state & operator=(state &&) = default;
 
-		state product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state) const;
+		// If contract is set, the result is reduced by bisimulation contraction (see contract).
+		state product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const;
+
+		// Returns the bisimulation contraction of this state, i.e. bisimilar worlds merged into one. The designated world remains world 0.
+		state contract(size_type num_agents, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const;
 
 		size_type get_num_worlds() const;
 
+		// Common state of bitsets over the worlds of this state, e.g. the results of formula::evaluate_all.
+		util::bitset<>::common_state get_worlds_bitset_state() const;
+
 		bool get_prop_valuation_actual_world(proposition_id prop, util::bitset<>::common_state proposition_bitset_state) const;
 
-		bool get_reachable_world_boolean(size_type w) const;
+		/*
+			Builds VT, the valuation transposed to one world set per proposition, from V.
+			States produced by product update from a state with VT have it as well, so enabling it on an initial state keeps it for all of its successors.
+		*/
+		void build_transposed_valuation(util::bitset<>::common_state proposition_bitset_state);
+		bool has_transposed_valuation() const;
+
+		/*
+			Stores the valuations of states produced by product update from this one as deltas against the valuations they are derived from.
+			The valuations of a state are kept while it is the latest one, and released once a successor has been derived from it; a released state materializes them again on first read.
+			Like VT, successors inherit the setting, so enabling it on an initial state covers a whole history.
+		*/
+		void enable_delta_valuations();
+
+		/*
+			Whether n holds at w, through a cache of the worlds satisfying the formulas of f evaluated this way on this state, keyed by node id.
+			The cache belongs to the first f it is used with, e.g. the formula pool of a domain, which must outlive the state; using it with another formula throws std::logic_error.
+			States are immutable after construction, so entries never go stale; the cache holds the results of at most capacity of the formulas asked about, subformulas not counted nor kept, and a miss on a full cache evicts the oldest one.
+			A capacity of 0 evaluates n without the cache, in ws.
+		*/
+		bool evaluate_cached(formula const & f, world_id w, formula::node_id n, util::bitset<>::common_state proposition_bitset_state, std::size_t capacity, workspace & ws) const;
+		std::size_t get_formula_cache_hits() const;
+		std::size_t get_formula_cache_misses() const;
 	private:
 		size_type num_worlds; 
 
-		// TODO: Please end this std::vector hell for storing collections which are static after construction.
-		// TODO: Replace vectors with unique_ptr to array, probably using uninitialized allocation and placement new to construct bitsets at offsets.
-		// TODO: Bitsets should take their working memory as an argument instead of doing their own individual allocations; makes collections of bitsets more efficient.
 		// TODO: Rcs is only really parameterized on num_worlds, which many states might share; we could extract it out one step.
-		util::bitset<>::common_state Rcs;
-		std::vector<util::bitset<>> R;
-		std::vector<util::bitset<>> V;
-
-		// TODO: Hack to eliminate unreachable worlds propagating by ignoring them in the next product update. Replace by bisimulation contraction or similar model reduction.
-		util::bitset<>::common_state reachable_worlds_cs; // DOUBT: still not sure what it exactly is
-		util::bitset<> reachable_worlds; // DOUBT: still not sure what it exactly is
-
+		util::bitset<>::common_state Wcs;
+		util::bit_matrix<>::common_state Rcs;
+		util::bit_matrix<>::common_state Gcs; // W x W, for relations over the worlds of this state which are not per agent.
+
+		std::unique_ptr<std::size_t[]> storage; // Of R; see get_storage_size.
+		util::bit_matrix<> R; // (A x W) -> 2^W, row a * W + w holds the worlds agent a accesses from w.
+
+		/*
+			The distinct valuations of one part (see valuation_part) of the valuations of a state.
+			With delta valuations enabled, each one is also kept as the valuation of the previous state it is derived from plus the bits flipped by the event, so the bits can be released and recomputed.
+			The flipped bits are stored rather than the event, as a state can't resolve events: it holds no reference to the domain's actions, which product_update only borrows, and factored events are subsets of touched propositions rather than event ids.
+			Chains of deltas are cut every delta_keyframe_interval states, by storing a state without deltas, to bound the work of materializing a state.
+		*/
+		struct valuation_store
+		{
+			util::bitset_vector<> sets; // Empty while released.
+			bool released = false;
+
+			bool delta_encoded_successors = false; // Whether states derived from this one use delta valuations.
+			std::shared_ptr<valuation_store> base; // Store the deltas refer to; empty for stores without deltas, which are never released.
+			size_type depth = 0; // Length of the chain of bases.
+			std::vector<std::pair<valuation_id, std::size_t>> deltas; // Per valuation, the valuation of base and the end of its flipped bits.
+			std::vector<size_type> flips;
+		};
+		static constexpr size_type delta_keyframe_interval = 16;
+
+		/*
+			Valuations of the worlds for one part of the propositions.
+			Valuations are interned, i.e. no two ids hold equal valuations, so comparing valuations amounts to comparing ids.
+			The one exception is an initial state under construction, where each world has a valuation of its own to set (see intern_valuations).
+			The store is shared with the successors encoding their valuations against it.
+		*/
+		struct valuation_part
+		{
+			std::shared_ptr<valuation_store> store;
+			std::vector<valuation_id> ids; // W -> valuation id.
+		};
+
+		/*
+			V holds the base propositions, over the proposition_bitset_state of the domain, and VA the attention propositions, as an A x P matrix per world over Acs (see attention.hpp).
+			The parts are interned separately, so worlds which only differ in attention share their base valuation and vice versa.
+		*/
+		util::bitset<>::common_state Acs;
+		valuation_part V;
+		valuation_part VA;
+
+		// Valuations of a part, materialized if released.
+		static size_type get_num_valuations(valuation_part const & part);
+		static util::bitset_vector<> const & get_valuation_sets(valuation_part const & part, util::bitset<>::common_state cs);
+		static util::bitset<>::const_span get_valuation(valuation_part const & part, world_id w, util::bitset<>::common_state cs);
+
+		static void materialize(valuation_store & store, util::bitset<>::common_state cs);
+		static void release(valuation_store & store);
+
+		// Makes the valuations of this new state, derived from s, deltas against those of s if s enables delta valuations.
+		void derive_valuations(state const & s);
+		// Makes the valuations of this new state deltas against the same store as those of from, for states copying the valuations of from.
+		void share_valuation_base(state const & from);
+		// Records the delta of valuation id of part, if it is new, against valuation v of from, the part it is derived from.
+		static void record_valuation_delta(valuation_part & part, valuation_id id, valuation_part const & from, valuation_id v, util::bitset<>::common_state cs);
+
+		// (P + A x P) x W, the transpose of V and VA, with a row per proposition id; optional, as it takes as much memory as the valuations. Lets formulas be evaluated on all worlds with one row per proposition.
+		util::bit_matrix<>::common_state VTcs;
+		std::optional<util::bit_matrix<>> VT;
+
+		// Blocks of storage for R.
+		std::size_t get_storage_size() const;
+
+		/*
+			Leaves R uninitialized instead of zeroing it and has no valuations yet, for the construction paths which write everything exactly once:
+			every world is assigned a valuation, and every row of R is cleared by clear_successors right before its successors are set.
+		*/
+		struct uninitialized_tag {};
+		state(size_type num_agents, size_type num_worlds, util::bitset<>::common_state proposition_bitset_state, uninitialized_tag);
+
+		// Product update with a factored action; see the corresponding action constructor.
+		state explicit_product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const;
+		state factored_product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const;
+
+		// Returns this state restricted to the worlds reachable from the designated world, renumbered densely. The designated world remains world 0.
+		state compact(size_type num_agents, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const;
+
+		/*
+			Returns the id of a valuation equal to the one just pushed to the back of the store of part, popping it again if there already is one.
+			interning.index must hold exactly the valuations of part, hashed.
+		*/
+		static valuation_id intern_last_valuation(valuation_part & part, util::bitset<>::common_state cs, workspace::valuation_interning & interning);
+
+		/*
+			Returns the id in part of the valuation of a new world derived from valuation v of from by event e, i.e. with the bits of del removed and those of add added.
+			Derived once per (v, e) through interning.memo, which must hold num_events entries per valuation of from, no_valuation for those not derived yet.
+		*/
+		static valuation_id derive_valuation(valuation_part & part, valuation_part const & from, valuation_id v, event_id e, size_type num_events,
+			util::bitset<>::const_span del, util::bitset<>::const_span add, util::bitset<>::common_state cs, workspace::valuation_interning & interning);
+
+		// Merges equal valuations, which set_valuation may have created; the initial state is interned this way once it is set up.
+		void intern_valuations(util::bitset<>::common_state proposition_bitset_state, workspace & ws);
+		static void intern_valuations(valuation_part & part, util::bitset<>::common_state cs, workspace::valuation_interning & interning);
+
+		/*
+			Gives world w the valuation of world from_w of state from, adding each valuation of from to this state at most once, so interned valuations stay interned.
+			The memos of ws map the valuations of from to those of this state, and must start out as no_valuation for all of them.
+		*/
+		static constexpr size_type no_valuation = static_cast<size_type>(-1);
+		void copy_valuation(world_id w, state const & from, world_id from_w, util::bitset<>::common_state proposition_bitset_state, workspace & ws);
+		static void copy_valuation(valuation_part & part, world_id w, valuation_part const & from, world_id from_w, util::bitset<>::common_state cs, std::vector<size_type> & memo);
+
+		// Attention propositions are answered from VA, see attention.hpp.
 		bool get_valuation(world_id w, proposition_id p, util::bitset<>::common_state proposition_bitset_state) const;
+		util::bitset<>::const_span get_valuation(world_id w, util::bitset<>::common_state proposition_bitset_state) const;
+		bool get_attention(world_id w, agent_id a, proposition_id p, util::bitset<>::common_state proposition_bitset_state) const;
+		// Only for states under construction by the domain, before intern_valuations.
 		void set_valuation(world_id w, proposition_id p, bool v, util::bitset<>::common_state proposition_bitset_state);
 
 		bool get_accessible(agent_id a, world_id w1, world_id w2) const;
 		void set_accessible(agent_id a, world_id w1, world_id w2, bool v);
+		void clear_successors(agent_id a, world_id w);
+
+		/*
+			Calls f(v) for every world v that a accesses from w, in increasing order, as long as f returns true.
+			Returns whether all such worlds were visited.
+		*/
+		template<typename F>
+		bool for_each_successor(agent_id a, world_id w, F && f) const
+		{
+			return this->R.for_each_in_row(this->Rcs, this->get_row(a, w), std::forward<F>(f));
+		}
+
+		// Row of R holding the successors of w for agent a.
+		std::size_t get_row(agent_id a, world_id w) const
+		{
+			return a.id * this->num_worlds + w.id;
+		}
+
+		// Union of the accessibility relations of a group of agents, and its transitive closure, each as one successor row per world.
+		// Computed on first use and cached per group; states are immutable after construction, so the cache is never invalidated.
+		struct group_relation
+		{
+			util::bit_matrix<> successors; // Over Gcs.
+			std::optional<util::bit_matrix<>> closure; // Over Gcs, empty until first requested.
+		};
+
+		// Groups are given as sorted agent ids without duplicates.
+		util::bit_matrix<> const & get_joint_successors(std::vector<size_type> const & group) const;
+		util::bit_matrix<> const & get_common_belief_closure(std::vector<size_type> const & group) const;
+		group_relation & get_group_relation(std::vector<size_type> const & group) const;
+		mutable std::map<std::vector<size_type>, group_relation> group_relations; // Sorted agent ids -> relation.
+
+		struct formula_cache
+		{
+			formula const * f = nullptr; // Whose node ids key the sets.
+			std::unordered_map<size_type, formula::world_set> sets; // Over Wcs.
+			std::deque<size_type> order; // Keys of sets, oldest first.
+			std::size_t hits = 0;
+			std::size_t misses = 0;
+		};
+		mutable std::unique_ptr<formula_cache> formula_results; // Empty until first used by evaluate_cached.
 	};
 }
@@ -49,4 +49,9 @@ namespace del {
 	{
 		size_type id;
 	};
+
+	struct valuation_id
+	{
+		size_type id;
+	};
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "del/types.hpp"
+
+#include "del/util/bitset.hpp"
+#include "del/util/hash.hpp"
+
+
+namespace del
+{
+	/*
+		Reusable working memory for product updates and formula evaluation, so that these don't allocate once the buffers have grown to the sizes of the states and actions involved.
+		Buffers only ever grow. A domain holds one and passes it into every update and evaluation; a workspace must not be used by several threads at once.
+	*/
+	class workspace
+	{
+		friend class formula;
+		friend class state;
+
+	public:
+		workspace() = default;
+
+		workspace(workspace const &) = delete;
+		workspace & operator=(workspace const &) = delete;
+		workspace(workspace &&) = default;
+		workspace & operator=(workspace &&) = default;
+
+	private:
+		/*
+			Pool of bitsets, handed out as a stack to nested operations.
+			All pooled bitsets have room for capacity bits, and are used with the common_state of the actual size, so they must be cleared after acquiring.
+		*/
+		size_type capacity = 0;
+		size_type used = 0;
+		std::deque<util::bitset<>> bitsets; // Deque, as handed out references must survive growth of the pool.
+
+		util::bitset<> & acquire(size_type num_bits);
+		void release(size_type count);
+
+		// Agent group of the operator being evaluated.
+		std::vector<size_type> group;
+
+		// Value stack of compiled formulas (see formula::run), shared by the nested runs of modal operands.
+		std::vector<std::uint8_t> values;
+
+		// Product update: the (world, event) pairs surviving their preconditions, the index of each as a new world, and the offsets into the event accessibility table.
+		std::vector<std::pair<world_id, event_id>> product_worlds;
+		std::vector<size_type> product_world_index;
+		std::vector<std::size_t> table_offset;
+
+		// Factored product update, with events as bitmasks.
+		using event_mask = std::uint64_t;
+
+		struct pair_hash
+		{
+			template<typename T, typename U>
+			std::size_t operator()(std::pair<T, U> const & p) const
+			{
+				std::size_t h = std::hash<T>()(p.first);
+				util::hash_combine(h, std::hash<U>()(p.second));
+				return h;
+			}
+		};
+
+		std::vector<event_mask> observed;
+		std::vector<std::pair<world_id, event_mask>> factored_worlds;
+		std::unordered_map<std::pair<size_type, event_mask>, size_type, pair_hash> factored_world_index;
+		std::vector<std::pair<agent_id, std::pair<size_type, size_type>>> edges;
+
+		/*
+			Valuation interning, for each part of the valuations (see state): hash of each valuation of the state being built -> its id,
+			and the id of the new valuation derived from each old one, e.g. per (old valuation, event), or per (old valuation, subset) in factored product updates.
+		*/
+		struct valuation_interning
+		{
+			std::unordered_multimap<std::size_t, size_type> index;
+			std::vector<size_type> memo;
+			std::unordered_map<std::pair<size_type, event_mask>, size_type, pair_hash> factored_memo;
+		};
+
+		valuation_interning base_interning;
+		valuation_interning attention_interning;
+
+		// Compaction: renumbering between old and new worlds.
+		std::vector<size_type> new_index;
+		std::vector<size_type> old_index;
+
+		// Contraction: the partition of the worlds and the signatures splitting it.
+		std::vector<size_type> block;
+		std::vector<size_type> next_block;
+		std::vector<size_type> signature;
+		std::vector<size_type> signatures; // Of the blocks of the round, concatenated.
+		std::vector<std::size_t> signature_offset; // Block -> start of its signature in signatures, and one past the end of the last.
+		std::unordered_multimap<std::size_t, size_type> signature_index; // Hash of a signature -> its block.
+		std::vector<size_type> representative;
+		std::unordered_map<std::pair<size_type, size_type>, size_type, pair_hash> valuation_block; // (valuation, attention matrix) -> block.
+	};
+}
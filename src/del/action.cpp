@@ -1,20 +1,31 @@
 #include "del/action.hpp"
 
+#include "del/attention.hpp"
+
 
 namespace del
 {
-	action::action(size_type num_agents, size_type num_events, util::bitset<>::common_state proposition_bitset_state) :
-		num_events(num_events), formulas(),							//tautology for pre condition for every event
-		Q(num_agents * num_events * num_events, formulas.new_bot()), pre(num_events, formulas.new_top()), post_add(), post_del()
+	action::action(size_type num_agents, size_type num_events, util::bitset<>::common_state proposition_bitset_state, std::shared_ptr<formula> pool) :
+		num_events(num_events), factored(false), formulas(pool ? std::move(pool) : std::make_shared<formula>(true)), bot(formulas->new_bot()),	//tautology for pre condition for every event
+		Q(num_agents * num_events), pre(num_events, formulas->new_top()),
+		post_add(proposition_bitset_state, num_events), post_del(proposition_bitset_state, num_events), //every event starts out changing no proposition
+		Acs(get_attention_bitset_state(num_agents, proposition_bitset_state)), attention_add(Acs, num_events), attention_del(Acs, num_events),
+		touched(), observes()
 		// NB! Q and pre uses formulas, so declaration order is important.
 	{
-		this->post_add.reserve(num_events); 
-		this->post_del.reserve(num_events);
-		for (size_type e = 0; e < num_events; ++e)
-		{
-			this->post_add.emplace_back(proposition_bitset_state); //every event representation is initialized with the current state proposition set 
-			this->post_del.emplace_back(proposition_bitset_state);
-		}
+	}
+
+	action::action(size_type num_agents, std::vector<proposition_id> const & add, std::vector<proposition_id> const & del, util::bitset<>::common_state proposition_bitset_state, std::shared_ptr<formula> pool) :
+		num_events(0), factored(true), formulas(pool ? std::move(pool) : std::make_shared<formula>(true)), bot(formulas->new_bot()),
+		Q(), pre(), post_add(proposition_bitset_state, 0), post_del(proposition_bitset_state, 0),
+		Acs(get_attention_bitset_state(num_agents, proposition_bitset_state)), attention_add(Acs, 0), attention_del(Acs, 0),
+		touched(), observes()
+	{
+		this->touched.reserve(add.size() + del.size());
+		for (proposition_id p : add) this->touched.push_back({ p, true });
+		for (proposition_id p : del) this->touched.push_back({ p, false });
+
+		this->observes.assign(num_agents * this->touched.size(), this->bot);
 	}
 
 	void action::set_pre(event_id e, formula::node_id f) 
@@ -29,27 +40,79 @@ namespace del
 
 	void action::set_post(event_id e, proposition_id p, bool v, util::bitset<>::common_state proposition_bitset_state)
 	{
-		if (v) this->post_add[e.id].set(proposition_bitset_state, p.id, true); //add if v true
-		else this->post_del[e.id].set(proposition_bitset_state, p.id, true);  // delete if v false
+		if (is_attention_proposition(p, proposition_bitset_state))
+		{
+			auto [a, q] = split_attention_proposition(p, proposition_bitset_state);
+			(v ? this->attention_add : this->attention_del).at(this->Acs, e.id).set(this->Acs, get_attention_bit(a, q, proposition_bitset_state), true);
+			return;
+		}
+
+		if (v) this->post_add.at(proposition_bitset_state, e.id).set(proposition_bitset_state, p.id, true); //add if v true
+		else this->post_del.at(proposition_bitset_state, e.id).set(proposition_bitset_state, p.id, true);  // delete if v false
+	}
+
+	util::bitset_array<>::const_span action::get_post_del(event_id e, util::bitset<>::common_state proposition_bitset_state) const
+	{
+		return this->post_del.at(proposition_bitset_state, e.id);
+	}
+
+	util::bitset_array<>::const_span action::get_post_add(event_id e, util::bitset<>::common_state proposition_bitset_state) const
+	{
+		return this->post_add.at(proposition_bitset_state, e.id);
 	}
 
-	util::bitset<> const & action::get_post_del(event_id e) const
+	util::bitset_array<>::const_span action::get_attention_del(event_id e) const
 	{
-		return this->post_del[e.id];
+		return this->attention_del.at(this->Acs, e.id);
 	}
 
-	util::bitset<> const & action::get_post_add(event_id e) const
+	util::bitset_array<>::const_span action::get_attention_add(event_id e) const
 	{
-		return this->post_add[e.id];
+		return this->attention_add.at(this->Acs, e.id);
 	}
 
 	void action::set_accessible(agent_id a, event_id e1, event_id e2, formula::node_id f)
 	{
-		this->Q[a.id * this->num_events * this->num_events + e1.id * this->num_events + e2.id] = f;
+		auto & accessible_events = this->Q[a.id * this->num_events + e1.id];
+		for (auto it = accessible_events.begin(); it != accessible_events.end(); ++it)
+		{
+			if (it->event.id == e2.id)
+			{
+				// Pairs not stored are BOT, so a condition folding to BOT removes the pair and the product update never looks at it.
+				if (this->formulas->is_bot(f)) accessible_events.erase(it);
+				else it->condition = f;
+				return;
+			}
+		}
+		if (!this->formulas->is_bot(f)) accessible_events.push_back({ e2, f });
 	}
 
 	formula::node_id action::get_accessible(agent_id a, event_id e1, event_id e2) const
 	{
-		return this->Q[a.id * this->num_events * this->num_events + e1.id * this->num_events + e2.id];
+		for (accessible_event const & entry : this->Q[a.id * this->num_events + e1.id])
+		{
+			if (entry.event.id == e2.id) return entry.condition;
+		}
+		return this->bot;
+	}
+
+	std::vector<action::accessible_event> const & action::get_accessible_events(agent_id a, event_id e) const
+	{
+		return this->Q[a.id * this->num_events + e.id];
+	}
+
+	size_type action::get_num_touched() const
+	{
+		return static_cast<size_type>(this->touched.size());
+	}
+
+	void action::set_observes(agent_id a, size_type t, formula::node_id f)
+	{
+		this->observes[a.id * this->touched.size() + t] = f;
+	}
+
+	formula::node_id action::get_observes(agent_id a, size_type t) const
+	{
+		return this->observes[a.id * this->touched.size() + t];
 	}
 }
@@ -1,23 +1,28 @@
 #include "del/domain.hpp"
+#include "del/attention.hpp"
 #include <iostream>
 #include <algorithm>
 #include <map>
 #include <set>
+#include <stdexcept>
 
 
 
 
 namespace del {
-	domain::domain(std::vector<std::string> const & agents, std::vector<std::string> const & propositions, std::vector<bool> const & default_values) :
-		// NB! proposition_bitset_state uses num_propositions to initialize, so order is important.
+	domain::domain(std::vector<std::string> const & agents, std::vector<std::string> const & propositions, std::vector<bool> const & default_values, bool lazy_attention_propositions) :
+		// NB! proposition_bitset_state uses num_non_attention_propositions to initialize, so order is important.
 		
 		num_non_attention_propositions(static_cast<size_type>(propositions.size())),
 		//propositions + attention propositions
 		num_agents(static_cast<size_type>(agents.size())), num_propositions(static_cast<size_type>(propositions.size() + agents.size()*propositions.size())),
-		proposition_bitset_state(num_propositions),
+		proposition_bitset_state(num_non_attention_propositions),
 		states(), actions(),
 		agents(agents), agent_name_to_id(),
-		propositions(propositions),propositions_default(default_values), prop_name_to_id()
+		propositions(propositions),propositions_default(default_values), prop_name_to_id(),
+		lazy_attention_propositions(lazy_attention_propositions), attention_proposition_names(), sees_propositions(),
+		formula_pool(std::make_shared<formula>(true)),
+		bisimulation_contraction(true), transposed_valuations(true), delta_valuations(false), formula_cache_capacity(0), working_memory()
 	{
 		//fill agent_name_to_id mapping
 		for (size_type a = 0; a < this->num_agents; ++a)
@@ -31,6 +36,31 @@ namespace del {
 			this->prop_name_to_id[this->propositions[p]] = proposition_id{ p };
 		}
 
+		//intern the sees propositions, the base propositions named a1_sees_a2, once
+		for (size_type a1 = 0; a1 < this->num_agents; ++a1)
+		{
+			for (size_type a2 = 0; a2 < this->num_agents; ++a2)
+			{
+				auto it = this->prop_name_to_id.find(this->get_sees_proposition_name(agent_id{ a1 }, agent_id{ a2 }));
+				this->sees_propositions.push_back(it != this->prop_name_to_id.end() ? it->second : proposition_id{ static_cast<size_type>(-1) });
+			}
+		}
+
+		std::cout << "Size non attention proposition set: "<< num_non_attention_propositions <<"\n";
+		// Prints just to control the domain proposition set
+		std::cout << "Size proposition set: "<< num_propositions <<"\n";
+
+		// Lazy attention propositions are only named once asked for, see register_attention_proposition
+		if (this->lazy_attention_propositions)
+		{
+			for (size_type p = 0; p < this->num_non_attention_propositions; ++p)
+			{
+				std::cout << this->propositions[p] <<"  ";
+				std::cout << this->get_proposition_default_value(proposition_id{ p }) <<"\n";
+			}
+			return;
+		}
+
 		//add attention propositions to the domain propositions set 
 		for (std::string const & a : this->agents)
 		{
@@ -50,10 +80,6 @@ namespace del {
 			this->prop_name_to_id[this->propositions[p]] = proposition_id{ p };
 		}
 
-		std::cout << "Size non attention proposition set: "<< num_non_attention_propositions <<"\n";
-		// Prints just to control the domain proposition set
-		std::cout << "Size proposition set: "<< num_propositions <<"\n";
-		
 		std::cout << "Size proposition default values set: "<< propositions_default.size() <<"\n";
 
 		for (size_type p = 0; p < this->num_propositions; ++p)
@@ -63,6 +89,26 @@ namespace del {
 		}
 	}
 
+	void domain::set_bisimulation_contraction(bool enabled)
+	{
+		this->bisimulation_contraction = enabled;
+	}
+
+	void domain::set_transposed_valuations(bool enabled)
+	{
+		this->transposed_valuations = enabled;
+	}
+
+	void domain::set_delta_valuations(bool enabled)
+	{
+		this->delta_valuations = enabled;
+	}
+
+	void domain::set_formula_cache(std::size_t capacity)
+	{
+		this->formula_cache_capacity = capacity;
+	}
+
 	size_type domain::get_num_agents() const
 	{
 		return this->num_agents;
@@ -83,12 +129,34 @@ namespace del {
 		return this->num_propositions;
 	}
 
+	util::bitset<>::common_state domain::get_proposition_bitset_state() const
+	{
+		return this->proposition_bitset_state;
+	}
+
 	proposition_id domain::get_proposition_id(std::string const& name) const 
 	{
 		auto it = this->prop_name_to_id.find(name);
 		if (it != this->prop_name_to_id.end()) {
 			return it->second; // Found
 		}
+
+		// Lazy attention propositions not yet named: agent name, then the base proposition name, see get_attention_proposition_name
+		if (this->lazy_attention_propositions)
+		{
+			for (size_type a = 0; a < this->num_agents; ++a)
+			{
+				std::string prefix = this->agents[a] + "_is_paying_attention_to_";
+				if (name.compare(0, prefix.size(), prefix) != 0) continue;
+
+				auto base = this->prop_name_to_id.find(name.substr(prefix.size()));
+				if (base == this->prop_name_to_id.end() || base->second.id >= this->num_non_attention_propositions) continue;
+
+				proposition_id p = this->get_attention_proposition_id(agent_id{ a }, base->second);
+				this->register_attention_proposition(p);
+				return p;
+			}
+		}
 		throw std::out_of_range("Proposition not found: " + name + "\n");
 	}
 /*
@@ -101,26 +169,43 @@ namespace del {
 */
 	std::string const & domain::get_proposition_name(proposition_id id) const
 	{
+		if (this->lazy_attention_propositions && id.id >= this->num_non_attention_propositions)
+		{
+			return this->register_attention_proposition(id);
+		}
 		return this->propositions[id.id];
 	}
 
+	std::string const & domain::register_attention_proposition(proposition_id p) const
+	{
+		auto it = this->attention_proposition_names.find(p.id);
+		if (it == this->attention_proposition_names.end())
+		{
+			auto [a, base] = split_attention_proposition(p, this->proposition_bitset_state);
+			it = this->attention_proposition_names.emplace(p.id, this->get_attention_proposition_name(a, base)).first;
+			this->prop_name_to_id[it->second] = p;
+		}
+		return it->second;
+	}
+
 	proposition_id domain::get_sees_proposition_id(agent_id a1, agent_id a2) const
 	{
-		return this->get_proposition_id(this->get_sees_proposition_name(a1, a2));
+		proposition_id p = this->sees_propositions[a1.id * this->num_agents + a2.id];
+		if (p.id == static_cast<size_type>(-1)) throw std::out_of_range("Proposition not found: " + this->get_sees_proposition_name(a1, a2) + "\n");
+		return p;
 	}
 
 	proposition_id domain::get_attention_proposition_id(agent_id a, proposition_id p) const
 	{
-		return this->get_proposition_id(this->get_attention_proposition_name(a, p));
+		return get_attention_proposition(a, p, this->proposition_bitset_state);
 	}
 
 	std::vector<proposition_id> domain::get_domain_non_attention_propositions_id() const
 	{
 		std::vector<proposition_id> propositions_id;
-		for(size_t i=0; i< this->num_non_attention_propositions; i++)
+		for(size_type i=0; i< this->num_non_attention_propositions; i++)
 		{
-
-			propositions_id.push_back(this->get_proposition_id(this->propositions[i]));
+			propositions_id.push_back(proposition_id{ i });
 		}
 		
 		return propositions_id;
@@ -139,8 +224,8 @@ namespace del {
 	std::vector<proposition_id> domain::get_domain_propositions_id() const
 	{
 		std::vector<proposition_id> propositions_id;
-		for (auto p: this->propositions)
-			propositions_id.push_back(this->get_proposition_id(p));
+		for (size_type p = 0; p < this->num_propositions; ++p)
+			propositions_id.push_back(proposition_id{ p });
 		
 		return propositions_id;
 	}
@@ -177,7 +262,7 @@ namespace del {
 			{
 				proposition_id p { i };
 				proposition_id attention_p = this->get_attention_proposition_id(a_id,p);
-				std::cout << "Attention p :"<<  this->get_proposition_name(attention_p)<< "\n";
+				std::cout << "Attention p :"<<  this->get_attention_proposition_name(a_id, p)<< "\n"; // Not get_proposition_name, which names lazy attention propositions
 
 				//confirm if attention_p is in add
 				if (std::find(add.begin(), add.end(), attention_p) == add.end()) 
@@ -207,9 +292,6 @@ namespace del {
 
 		state & s = this->states.emplace_back(num_agents, num_states, this->proposition_bitset_state);
 
-		// TODO: Hack to eliminate unreachable worlds propagating by ignoring them in the next product update. Replace by bisimulation contraction or similar model reduction.
-
-
 		world_id w0 = world_id{ 0 };
 
 		//set value of propositions contained in add to true at the initial world 
@@ -295,10 +377,17 @@ namespace del {
 				}
 			}
 		}
-		
-		for(size_type w=0; w<s.num_worlds;w++)
+
+		s.intern_valuations(this->proposition_bitset_state, this->working_memory);
+
+		if (this->transposed_valuations)
+		{
+			s.build_transposed_valuation(this->proposition_bitset_state);
+		}
+
+		if (this->delta_valuations)
 		{
-			s.reachable_worlds.set(s.reachable_worlds_cs, w, true);  //set the world index  to reachable
+			s.enable_delta_valuations();
 		}
 
 		//std::cout << "Number of worlds: " << s.get_num_worlds();
@@ -308,141 +397,30 @@ namespace del {
 	std::pair<action_id, state_id> domain::perform_do(agent_id i, std::vector<proposition_id> add, std::vector<proposition_id> del)
 	{
 		action_id do_action_id = { static_cast<size_type>(this->actions.size()) };
-		
-
-		//number of events in each action is not static anymore, it depends from the number of atoms involved in the post action (2^n)
-		size_type num_events= 1 << (add.size()+del.size());
-
-		action & do_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
-
-
-		event_id e0{ 0 };
-		event_id e1{ 1 };
-
-		// Preconditions: Always applicable by default.
-
-		// Postconditions: No change by default.
-		// e0 : event representing the "expected" changes after the action 
-		// e1 : event representing no changes after the action
-		for (auto p : add)
-		{
-			do_action.set_post(e0, p, true, this->proposition_bitset_state);
-		}
-
-		for (auto p : del)
-		{
-			do_action.set_post(e0, p, false, this->proposition_bitset_state);
-		}
-		
-		std::vector<std::vector<proposition_id>> set_subsets_add = util::generate_subsets(add);
-		std::vector<std::vector<proposition_id>> set_subsets_del = util::generate_subsets(del);
 
-		// First and last subsets of each set are respectively empty and full
+		// The action has one event per subset of the changed propositions (the ones an observer attends to), so it is built in factored form:
+		// instead of 2^(|add|+|del|) events, each changed proposition carries the condition under which an agent observes its change.
+		// The designated event applies every change; an agent paying attention to exactly the subset S of changed propositions accesses the event applying only S.
+		action & do_action = this->actions.emplace_back(this->num_agents, add, del, this->proposition_bitset_state, this->formula_pool);
 
-		std::vector<std::vector<proposition_id>> set_subsets_propositions; // contains the propostions each event pays attention
-
-		std::vector<proposition_id>  subset_propositions=add;
-		subset_propositions.insert(subset_propositions.end(), del.begin(), del.end()); 
-    	
-		set_subsets_propositions.push_back(subset_propositions);  // First element (e0)
-		set_subsets_propositions.push_back({}); // Second element (e1)
-		
-		// set_post for remaining $num_event - 2$ events 
-		for (auto subset_add : set_subsets_add)
-		{
-			for (auto subset_del : set_subsets_del)
-			{
-				if(subset_del.size()==del.size() && subset_add.size()==add.size()) continue; //e0
-				if(subset_del.empty() && subset_add.empty()) continue; //e1
-
-				subset_propositions.clear();
-				subset_propositions.insert(subset_propositions.end(), subset_add.begin(), subset_add.end()); 
-				subset_propositions.insert(subset_propositions.end(), subset_del.begin(), subset_del.end());
-				
-				set_subsets_propositions.push_back(subset_propositions); //size updated 
-				 
-				event_id current_e{ static_cast<del::size_type>(set_subsets_propositions.size() - 1)}; 
-
-				for (auto p : subset_add)
-				{
-					do_action.set_post(current_e, p, true, this->proposition_bitset_state);
-				}
-
-				
-				for (auto p : subset_del)
-				{
-					do_action.set_post(current_e, p, false, this->proposition_bitset_state);
-				}				
-			}
-		}
-		
-		// Accessibility: Nothing accessible by default.
-		formula & f = do_action.formulas;
-		formula::node_id f_TOP = f.new_top();
+		formula & f = *do_action.formulas;
 		for (size_type j = 0; j < this->num_agents; ++j)
 		{
-			agent_id j_id{ j };	
-			
-			std::vector<formula::node_id>  action_all_attention_propositions, action_no_attention_propositions;
-			subset_propositions.clear();
-			subset_propositions=set_subsets_propositions[0]; //full set
-			for(proposition_id p : subset_propositions)
-			{
-				action_all_attention_propositions.emplace_back(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p))));
-				action_no_attention_propositions.emplace_back(f.new_not(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p)))));
-			}
-			
-			formula::node_id j_pays_attention_to_all_p= f.new_and(action_all_attention_propositions);
-			formula::node_id j_pays_no_attention= f.new_and(action_no_attention_propositions);
-
-			do_action.set_accessible(j_id, e0, e0, j_pays_attention_to_all_p);
-
-			//j_id accesses e0->e1 if j_id is not paying attention to any of the changed propositions in this action
-			do_action.set_accessible(j_id, e0, e1, j_pays_no_attention);
-			do_action.set_accessible(j_id, e1, e1, f_TOP);
-
-			// e0 inaccessible from e1 by default.
+			agent_id j_id{ j };
 
-			// All other events are accessible from e0, with the corresponding attention propositions as conditions.
-			// Each event is accessible to itself with a tautology (always true) condition.
-			
-			for (size_t h = 2; h < set_subsets_propositions.size(); ++h) // Not Permanent: to avoid e0 and e1 propositions subsets
+			// Touched propositions are numbered add first, then del.
+			size_type t = 0;
+			for (std::vector<proposition_id> const * changed : { &add, &del })
 			{
-				subset_propositions.clear();
-    			subset_propositions = set_subsets_propositions[h];
-
-				std::vector<formula::node_id> subset_attention_conditions;
-
-				for(proposition_id p : subset_propositions)
+				for (proposition_id p : *changed)
 				{
-					subset_attention_conditions.emplace_back(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p))));
+					do_action.set_observes(j_id, t++, f.new_prop(this->get_attention_proposition_id(j_id, p)));
 				}
-
-				// set_subsets_propositions[0] is add + del propositions
-				std::vector<proposition_id> inattention_propositions = this->get_remaining_non_attention_propositions(subset_propositions, set_subsets_propositions[0]);
-
-
-				for (auto prop : inattention_propositions) {
-					subset_attention_conditions.push_back(f.new_not(f.new_prop(this->get_attention_proposition_id(j_id, prop))));
-				}
-
-				formula::node_id j_attentive_to_subset = f.new_and(subset_attention_conditions);
-
-				event_id current_e{ static_cast<del::size_type>(h) }; 
-				
-				//e0 -> current_e
-				do_action.set_accessible(j_id, e0, current_e, j_attentive_to_subset);
-
-				//do_action.set_pre(current_e, j_pays_attention_to_p);
-
-				//current_e -> current_e
-				do_action.set_accessible(j_id, current_e, current_e, f_TOP);
-				 
 			}
-		}  
+		}
 
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(do_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(do_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { do_action_id, new_state_id };
 	}
@@ -455,7 +433,7 @@ namespace del {
 
 		action_id ac_action_id = { static_cast<size_type>(this->actions.size()) };
 
-    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		event_id e0{0};
 
@@ -474,7 +452,7 @@ namespace del {
 		}
 
 		// Accesibility: Nothing accessible by default.
-		formula & f = ac_action.formulas;
+		formula & f = *ac_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 		for (size_type j = 0; j < this->num_agents; ++j)
 		{
@@ -485,7 +463,7 @@ namespace del {
 
 		// Apply the product update
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -502,7 +480,7 @@ namespace del {
 
 		size_type num_events = 1 << add.size();  // 2^(|add|) possible subsets of add propositions
 
-		action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+		action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		event_id e0{ 0 }; //e0 represents the event for the agents that performed the public attention shift (attention and prop value updated)
 
@@ -535,7 +513,7 @@ namespace del {
 			}
 		}
 
-    	formula & f = ac_action.formulas;
+    	formula & f = *ac_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 
 		//Accessibility
@@ -615,7 +593,7 @@ namespace del {
 
 		// Apply the product update
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -629,7 +607,7 @@ namespace del {
 
 		action_id ac_action_id = { static_cast<size_type>(this->actions.size()) };
 
-    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		event_id agent_performer_event{0};
 		event_id others_event{1};
@@ -646,7 +624,7 @@ namespace del {
 		}
 
 		// Accesibility: Nothing accessible by default.
-		formula & f = ac_action.formulas;
+		formula & f = *ac_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 		for (size_type j = 0; j < this->num_agents; ++j)
 		{
@@ -667,7 +645,7 @@ namespace del {
 
 		// Apply the product update
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -681,7 +659,7 @@ namespace del {
 
 		action_id ac_action_id = { static_cast<size_type>(this->actions.size()) };
 
-    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		state_id last_state_id = { static_cast<size_type>(this->states.size() - 1) };
     	state const & last_state = this->get_state(last_state_id);
@@ -704,7 +682,7 @@ namespace del {
 		}
 
 		// Accesibility: Nothing accessible by default.
-		formula & f = ac_action.formulas;
+		formula & f = *ac_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 		for (size_type j = 0; j < this->num_agents; ++j)
 		{
@@ -725,7 +703,7 @@ namespace del {
 
 		// Apply the product update
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -747,7 +725,7 @@ namespace del {
 		if(del.empty()) num_events=num_add_events;
 		else num_events=num_add_events + 1;
 
-    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+    	action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		state_id last_state_id = { static_cast<size_type>(this->states.size() - 1) };
     	state const & last_state = this->get_state(last_state_id);
@@ -769,7 +747,7 @@ namespace del {
 			ac_action.set_post(agent_performer_event, prop, prop_actual_valuation, this->proposition_bitset_state); // Add prop current valuation
 		}
 
-    	formula & f = ac_action.formulas;
+    	formula & f = *ac_action.formulas;
     	formula::node_id f_TOP = f.new_top();
 
 		//TODO: (**) Add attention change with possibility for the agent to no be aware of delete
@@ -850,7 +828,7 @@ namespace del {
 
 		// Apply the product update
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -865,7 +843,7 @@ namespace del {
 		//number of events in each action is not static anymore, it depends from the number of atoms involved in the post action (2^n)
 		size_type num_events= 1 << (add.size()+del.size());
 
-		action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state);
+		action & ac_action = this->actions.emplace_back(this->num_agents, num_events, this->proposition_bitset_state, this->formula_pool);
 
 		//Temporary
 		state_id last_state_id = { static_cast<size_type>(this->states.size() - 1) };
@@ -895,7 +873,7 @@ namespace del {
 		}
 
 		// Accessibility: Nothing accessible by default.
-		formula & f = ac_action.formulas;
+		formula & f = *ac_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 
 		//the agent who performs the private attention shift unconditionally accesses e0
@@ -963,8 +941,8 @@ namespace del {
 			subset_propositions=set_subsets_propositions[0]; //full set
 			for(proposition_id p : subset_propositions)
 			{
-				action_all_attention_propositions.emplace_back(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p))));
-				action_no_attention_propositions.emplace_back(f.new_not(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p)))));
+				action_all_attention_propositions.emplace_back(f.new_prop(this->get_attention_proposition_id(j_id, p)));
+				action_no_attention_propositions.emplace_back(f.new_not(f.new_prop(this->get_attention_proposition_id(j_id, p))));
 			}
 			
 			formula::node_id j_pays_attention_to_all_p= f.new_and(action_all_attention_propositions);
@@ -990,7 +968,7 @@ namespace del {
 
 				for(proposition_id p : subset_propositions)
 				{
-					subset_attention_conditions.emplace_back(f.new_prop( this->get_proposition_id(this->get_attention_proposition_name(j_id, p))));
+					subset_attention_conditions.emplace_back(f.new_prop(this->get_attention_proposition_id(j_id, p)));
 				}
 
 				// set_subsets_propositions[0] is add + del propositions
@@ -1018,7 +996,7 @@ namespace del {
 		}  
 
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(ac_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { ac_action_id, new_state_id };
 	}
@@ -1027,7 +1005,7 @@ namespace del {
 	std::pair<action_id, state_id> domain::perform_oc(std::vector<std::pair<agent_id, agent_id>> add, std::vector<std::pair<agent_id, agent_id>> del)
 	{
 		action_id oc_action_id = { static_cast<size_type>(this->actions.size()) };
-		action & oc_action = this->actions.emplace_back(this->num_agents, 2, this->proposition_bitset_state);
+		action & oc_action = this->actions.emplace_back(this->num_agents, 2, this->proposition_bitset_state, this->formula_pool);
 
 		event_id e0{ 0 };
 		event_id e1{ 1 };
@@ -1050,7 +1028,7 @@ namespace del {
 		}
 
 		// Accesibility: Nothing accessible by default.
-		formula & f = oc_action.formulas;
+		formula & f = *oc_action.formulas;
 		formula::node_id f_TOP = f.new_top();
 		for (size_type j = 0; j < this->num_agents; ++j)
 		{
@@ -1064,14 +1042,33 @@ namespace del {
 		}
 
 		state_id new_state_id = { static_cast<size_type>(this->states.size()) };
-		state & new_state = this->states.emplace_back(this->states.back().product_update(oc_action, this->num_agents, this->proposition_bitset_state));
+		state & new_state = this->states.emplace_back(this->states.back().product_update(oc_action, this->num_agents, this->proposition_bitset_state, this->bisimulation_contraction, this->working_memory));
 
 		return { oc_action_id, new_state_id };
 	}
 */
 	bool domain::evaluate_formula(state_id s, formula const & f, formula::node_id n) const
 	{
-		return f.evaluate(this->get_state(s), world_id{ 0 }, n, this->proposition_bitset_state);
+		if (this->formula_cache_capacity != 0 && &f == this->formula_pool.get())
+		{
+			return this->get_state(s).evaluate_cached(f, world_id{ 0 }, n, this->proposition_bitset_state, this->formula_cache_capacity, this->working_memory);
+		}
+		return f.evaluate(this->get_state(s), world_id{ 0 }, n, this->proposition_bitset_state, this->working_memory);
+	}
+
+	bool domain::evaluate_formula(state_id s, formula::node_id n) const
+	{
+		return this->evaluate_formula(s, *this->formula_pool, n);
+	}
+
+	formula & domain::get_formulas()
+	{
+		return *this->formula_pool;
+	}
+
+	formula const & domain::get_formulas() const
+	{
+		return *this->formula_pool;
 	}
 
 	std::string domain::get_sees_proposition_name(agent_id a1, agent_id a2) const
@@ -1083,24 +1080,20 @@ namespace del {
 	{
 		return this->get_agent_name(a) + "_is_paying_attention_to_" + this->get_proposition_name(p);
 	}
-/*
+
 	std::pair<agent_id, proposition_id> domain::get_agent_and_proposition(proposition_id attention_prop) const {
-		auto it = this->attention_map.find(attention_prop.id);
-		if (it != attention_map.end()) {
-			return it->second;
-		} else {
+		if (!is_attention_proposition(attention_prop, this->proposition_bitset_state) || attention_prop.id >= this->num_propositions) {
 			throw std::invalid_argument("Attention proposition not found.");
 		}
+		return split_attention_proposition(attention_prop, this->proposition_bitset_state);
 	}
-	*/
+
 	void domain::print_state_overview(state const & s, std::vector<proposition_id> const propositions) const
 	{
 		
 		size_type num_worlds= s.get_num_worlds();
 		for (size_type wid = 0; wid < num_worlds; ++wid)
 		{
-			if(! s.get_reachable_world_boolean(wid) ) continue;
-			
 			world_id w{wid};
 			std::cout << "------ World " << wid << " ------\n" ;
 			for (proposition_id p : propositions)				
@@ -1113,9 +1106,16 @@ namespace del {
 				agent_id a {aid};
 				std::cout << " " << this->get_agent_name(a) <<  ": " ;		
 
+				// One scan of the successor row of (a, w), rather than a lookup per pair of worlds.
+				std::vector<bool> accessible(num_worlds, false);
+				s.for_each_successor(a, w, [&](size_type vid)
+				{
+					accessible[vid] = true;
+					return true;
+				});
 				for (size_type vid = 0; vid < num_worlds; ++vid)
 				{
-					std::cout << "w" << vid << ": "<<  (s.get_accessible(a , w, world_id{ vid }) ? "true" : "false") << "|" ;
+					std::cout << "w" << vid << ": "<<  (accessible[vid] ? "true" : "false") << "|" ;
 				}
 				std::cout << "\n";	
 			}	
@@ -1129,7 +1129,7 @@ namespace del {
 
 		auto non_attention_propositions = this->get_domain_non_attention_propositions_id();
 
-		formula f;
+		formula f; // Local, so that a const domain leaves the pool as it is.
 		for(auto name: this->agents)
 		{
 			bool some_attention=false;
@@ -1178,6 +1178,10 @@ namespace del {
 
 	bool domain::get_proposition_default_value(proposition_id p) const
 	{
+		if (this->lazy_attention_propositions && p.id >= this->num_non_attention_propositions)
+		{
+			return true; // Attention propositions default to true, see the constructor
+		}
 		return this->propositions_default[p.id];
 	} 
 
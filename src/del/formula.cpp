@@ -1,34 +1,46 @@
 #include "del/formula.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 
+#include "del/attention.hpp"
 #include "del/domain.hpp"
 #include "del/state.hpp"
+#include "del/util/hash.hpp"
 
 #include <iostream>
 
 
 namespace del
 {
+	formula::formula(bool simplify) :
+		nodes(), simplify(simplify), node_index(), program(), segment()
+	{
+	}
+
 	formula::node_id formula::new_null()
 	{
 		node_id new_node_id{static_cast<size_type>(this->nodes.size())};
 		this->nodes.emplace_back(formula_type::EMPTY);
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 	formula::node_id formula::new_top()
 	{
 		node_id new_node_id { static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::TOP);
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_bot()
 	{
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::BOT);
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_prop(proposition_id p)
@@ -36,19 +48,48 @@ namespace del
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::PROP);
 		this->nodes.emplace_back(p);
-		return new_node_id;
+		return this->intern(new_node_id.id);
+	}
+
+	formula::node_id formula::new_attention(agent_id a, proposition_id p)
+	{ /*ATTENTION, agent id, base proposition */
+		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
+		this->nodes.emplace_back(formula_type::ATTENTION);
+		this->nodes.emplace_back(a);
+		this->nodes.emplace_back(p);
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_not(node_id f)
 	{
+		if (this->simplify)
+		{
+			switch (this->nodes[f.id].type)
+			{
+				case formula_type::TOP: return this->new_bot();
+				case formula_type::BOT: return this->new_top();
+				case formula_type::NOT: return this->nodes[f.id + 1].nid;
+				default: break;
+			}
+		}
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::NOT);
 		this->nodes.emplace_back(f);
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_and(std::vector<node_id> conjuncts)
 	{ /*AND , number of disjuncts, conjucts*/
+		if (this->simplify)
+		{
+			std::vector<node_id> collected;
+			if (!this->collect_operands(formula_type::AND, conjuncts, collected)) return this->new_bot();
+			if (collected.empty()) return this->new_top();
+			if (collected.size() == 1) return collected[0];
+			conjuncts = std::move(collected);
+		}
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::AND);
 		//number of conjuncts is the info contained in node after AND node
@@ -57,11 +98,20 @@ namespace del
 		{
 			this->nodes.emplace_back(conjunct);
 		}
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_or(std::vector<node_id> disjuncts)
 	{ /*OR , number of disjuncts, disjuncts*/
+		if (this->simplify)
+		{
+			std::vector<node_id> collected;
+			if (!this->collect_operands(formula_type::OR, disjuncts, collected)) return this->new_top();
+			if (collected.empty()) return this->new_bot();
+			if (collected.size() == 1) return collected[0];
+			disjuncts = std::move(collected);
+		}
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::OR);
 		//number of disjuncts is the info contained in node after AND node
@@ -70,22 +120,27 @@ namespace del
 		{
 			this->nodes.emplace_back(disjunct);
 		}
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_believes(agent_id a, node_id f)
 	{ /*Believes , agent id, formula */
+		if (this->simplify && this->is_top(f)) return f;
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::BELIEVES);
 		//agent id is the next node
 		this->nodes.emplace_back(a); 
 		//formula comes next
 		this->nodes.emplace_back(f);
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_everyone_believes(std::vector<agent_id> const & as, size_type order, node_id f)
 	{ /* Everyone Believes , number of agents, agents ids, formula */
+		// f must hold at the world itself, so BOT stays BOT, and with order 0 only there.
+		if (this->simplify && (this->is_top(f) || this->is_bot(f) || order == 0)) return f;
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::EVERYONE_BELIEVES);
 		this->nodes.emplace_back(static_cast<size_type>(as.size())); //number of agents come next
@@ -95,11 +150,13 @@ namespace del
 		}
 		this->nodes.emplace_back(order); //order comes next
 		this->nodes.emplace_back(f); //formula comes next
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
 
 	formula::node_id formula::new_common_belief(std::vector<agent_id> const & as, node_id f)
 	{ /*Common Belief , number of agents, agents ids, formula */
+		if (this->simplify && this->is_top(f)) return f;
+
 		node_id new_node_id{ static_cast<size_type>(this->nodes.size()) };
 		this->nodes.emplace_back(formula_type::COMMON_BELIEF);
 		this->nodes.emplace_back(static_cast<size_type>(as.size())); //number of agents come next
@@ -108,47 +165,487 @@ namespace del
 			this->nodes.emplace_back(a); //agent ids come next
 		}
 		this->nodes.emplace_back(f); //formula comes next
-		return new_node_id;
+		return this->intern(new_node_id.id);
 	}
+	size_type formula::get_node_size(node_id n) const
+	{
+		switch (this->nodes[n.id].type)
+		{
+			case formula_type::TOP:
+			case formula_type::BOT:
+			case formula_type::EMPTY:
+				return 1;
+			case formula_type::PROP:
+			case formula_type::NOT:
+				return 2;
+			case formula_type::ATTENTION:
+			case formula_type::BELIEVES:
+				return 3;
+			case formula_type::AND:
+			case formula_type::OR:
+				return 2 + this->nodes[n.id + 1].count;
+			case formula_type::EVERYONE_BELIEVES:
+				return 2 + this->nodes[n.id + 1].count + 2;
+			case formula_type::COMMON_BELIEF:
+				return 2 + this->nodes[n.id + 1].count + 1;
+		}
+
+#if defined(_MSC_VER)
+		__assume(false);
+#elif defined(__GNUG__) || defined(__clang__)
+		__builtin_unreachable();
+#else
+		throw std::runtime_error("unreachable code");
+#endif
+	}
+
+	formula::node_id formula::intern(size_type first)
+	{
+		static_assert(sizeof(node) == sizeof(size_type), "nodes are compared and hashed as size_type cells");
+
+		// Cells are hashed and compared by their bytes, whichever member of the union they hold.
+		size_type size = static_cast<size_type>(this->nodes.size()) - first;
+		std::size_t h = 0;
+		for (size_type i = first; i < first + size; ++i)
+		{
+			size_type cell;
+			std::memcpy(&cell, &this->nodes[i], sizeof(cell));
+			util::hash_combine(h, std::hash<size_type>()(cell));
+		}
+
+		auto [begin, end] = this->node_index.equal_range(h);
+		for (auto it = begin; it != end; ++it)
+		{
+			node_id existing{ it->second };
+			if (this->get_node_size(existing) == size && std::memcmp(&this->nodes[existing.id], &this->nodes[first], size * sizeof(node)) == 0)
+			{
+				this->nodes.resize(first, formula_type::EMPTY);
+				return existing;
+			}
+		}
+
+		this->node_index.emplace(h, first);
+		return node_id{ first };
+	}
+
 		bool formula::isNull(node_id n) const
 		{
 			return this->nodes[n.id].type == formula_type::EMPTY;
 		}
 
+	bool formula::is_top(node_id n) const
+	{
+		return this->nodes[n.id].type == formula_type::TOP;
+	}
+
+	bool formula::is_bot(node_id n) const
+	{
+		return this->nodes[n.id].type == formula_type::BOT;
+	}
+
+	bool formula::collect_operands(formula_type type, std::vector<node_id> const & operands, std::vector<node_id> & collected) const
+	{
+		formula_type absorbed = type == formula_type::AND ? formula_type::TOP : formula_type::BOT;
+		formula_type deciding = type == formula_type::AND ? formula_type::BOT : formula_type::TOP;
+
+		for (node_id operand : operands)
+		{
+			formula_type operand_type = this->nodes[operand.id].type;
+			if (operand_type == absorbed) continue;
+			if (operand_type == deciding) return false;
+			if (operand_type == type)
+			{
+				size_type count = this->nodes[operand.id + 1].count;
+				std::vector<node_id> nested;
+				for (size_type i = 0; i < count; ++i)
+				{
+					nested.push_back(this->nodes[operand.id + 2 + i].nid);
+				}
+				if (!this->collect_operands(type, nested, collected)) return false;
+				continue;
+			}
+			// Nodes are hash-consed, so equal operands have equal ids.
+			if (std::none_of(collected.begin(), collected.end(), [&](node_id c) { return c.id == operand.id; })) collected.push_back(operand);
+		}
+		return true;
+	}
+
+	void formula::get_group(size_type first, size_type count, std::vector<size_type> & group) const
+	{
+		group.clear();
+		for (size_type i = 0; i < count; ++i)
+		{
+			group.push_back(this->nodes[first + i].agent.id);
+		}
+		std::sort(group.begin(), group.end());
+		group.erase(std::unique(group.begin(), group.end()), group.end());
+	}
+
 	bool formula::evaluate(state const & s, world_id w, node_id n, util::bitset<>::common_state proposition_bitset_state) const
+	{
+		workspace ws;
+		return this->evaluate(s, w, n, proposition_bitset_state, ws);
+	}
+
+	bool formula::evaluate(state const & s, world_id w, node_id n, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const
+	{
+		return this->run(this->compile(n), s, w, proposition_bitset_state, ws);
+	}
+
+	size_type formula::compile(node_id n) const
+	{
+		auto it = this->segment.find(n.id);
+		if (it != this->segment.end())
+		{
+			return it->second;
+		}
+
+		// Segments are contiguous, so the operands of modal operators are compiled before this segment is started.
+		this->compile_operands(n);
+		size_type start = static_cast<size_type>(this->program.size());
+		this->emit(n);
+		this->program.push_back({ opcode::RETURN, 0, 0 });
+		this->segment.emplace(n.id, start);
+		return start;
+	}
+
+	void formula::compile_operands(node_id n) const
+	{
+		switch (this->nodes[n.id].type)
+		{
+			case formula_type::NOT:
+			{
+				this->compile_operands(this->nodes[n.id + 1].nid);
+				break;
+			}
+			case formula_type::AND:
+			case formula_type::OR:
+			{
+				size_type count = this->nodes[n.id + 1].count;
+				for (size_type i = 0; i < count; ++i)
+				{
+					this->compile_operands(this->nodes[n.id + 2 + i].nid);
+				}
+				break;
+			}
+			case formula_type::BELIEVES:
+			{
+				this->compile(this->nodes[n.id + 2].nid);
+				break;
+			}
+			case formula_type::EVERYONE_BELIEVES:
+			{
+				size_type num_agents = this->nodes[n.id + 1].count;
+				this->compile(this->nodes[n.id + 2 + num_agents + 1].nid);
+				break;
+			}
+			case formula_type::COMMON_BELIEF:
+			{
+				size_type num_agents = this->nodes[n.id + 1].count;
+				this->compile(this->nodes[n.id + 2 + num_agents].nid);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	void formula::emit(node_id n) const
 	{
+		switch (this->nodes[n.id].type)
+		{
+			case formula_type::TOP:
+			{
+				this->program.push_back({ opcode::TOP, 0, 0 });
+				return;
+			}
+			case formula_type::BOT:
+			case formula_type::EMPTY: // Treat EMPTY as invalid
+			{
+				this->program.push_back({ opcode::BOT, 0, 0 });
+				return;
+			}
+			case formula_type::PROP:
+			{
+				this->program.push_back({ opcode::PROP, this->nodes[n.id + 1].prop.id, 0 });
+				return;
+			}
+			case formula_type::ATTENTION:
+			{
+				this->program.push_back({ opcode::ATTENTION, this->nodes[n.id + 1].agent.id, this->nodes[n.id + 2].prop.id });
+				return;
+			}
+			case formula_type::NOT:
+			{
+				this->emit(this->nodes[n.id + 1].nid);
+				this->program.push_back({ opcode::NOT, 0, 0 });
+				return;
+			}
+			case formula_type::AND:
+			case formula_type::OR:
+			{
+				// c1 JUMP c2 JUMP ... cn: each jump leaves the deciding value for the whole node, or pops the value to go on with the next operand.
+				bool is_and = this->nodes[n.id].type == formula_type::AND;
+				size_type count = this->nodes[n.id + 1].count;
+				if (count == 0)
+				{
+					this->program.push_back({ is_and ? opcode::TOP : opcode::BOT, 0, 0 });
+					return;
+				}
+
+				std::size_t first_jump = this->program.size();
+				for (size_type i = 0; i < count; ++i)
+				{
+					this->emit(this->nodes[n.id + 2 + i].nid);
+					if (i + 1 < count) this->program.push_back({ is_and ? opcode::JUMP_IF_FALSE : opcode::JUMP_IF_TRUE, 0, 0 });
+				}
+
+				size_type end = static_cast<size_type>(this->program.size());
+				for (std::size_t i = first_jump; i < end; ++i)
+				{
+					// Jumps of nested nodes already have their target.
+					opcode op = this->program[i].op;
+					if ((op == opcode::JUMP_IF_FALSE || op == opcode::JUMP_IF_TRUE) && this->program[i].a == 0) this->program[i].a = end;
+				}
+				return;
+			}
+			case formula_type::BELIEVES:
+			{
+				this->program.push_back({ opcode::BELIEVES, this->nodes[n.id + 1].agent.id, this->segment.at(this->nodes[n.id + 2].nid.id) });
+				return;
+			}
+			case formula_type::EVERYONE_BELIEVES:
+			{
+				size_type num_agents = this->nodes[n.id + 1].count;
+				this->program.push_back({ opcode::EVERYONE_BELIEVES, n.id, this->segment.at(this->nodes[n.id + 2 + num_agents + 1].nid.id) });
+				return;
+			}
+			case formula_type::COMMON_BELIEF:
+			{
+				size_type num_agents = this->nodes[n.id + 1].count;
+				this->program.push_back({ opcode::COMMON_BELIEF, n.id, this->segment.at(this->nodes[n.id + 2 + num_agents].nid.id) });
+				return;
+			}
+		}
+	}
+
+	bool formula::run(size_type start, state const & s, world_id w, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const
+	{
+		std::vector<std::uint8_t> & values = ws.values;
+		for (size_type pc = start; ; ++pc)
+		{
+			instruction const & i = this->program[pc];
+			switch (i.op)
+			{
+				case opcode::TOP:
+				{
+					values.push_back(true);
+					break;
+				}
+				case opcode::BOT:
+				{
+					values.push_back(false);
+					break;
+				}
+				case opcode::PROP:
+				{
+					values.push_back(s.get_valuation(w, proposition_id{ i.a }, proposition_bitset_state));
+					break;
+				}
+				case opcode::ATTENTION:
+				{
+					values.push_back(s.get_attention(w, agent_id{ i.a }, proposition_id{ i.b }, proposition_bitset_state));
+					break;
+				}
+				case opcode::NOT:
+				{
+					values.back() = !values.back();
+					break;
+				}
+				case opcode::JUMP_IF_FALSE:
+				case opcode::JUMP_IF_TRUE:
+				{
+					if (static_cast<bool>(values.back()) == (i.op == opcode::JUMP_IF_TRUE))
+					{
+						pc = i.a - 1;
+						break;
+					}
+					values.pop_back();
+					break;
+				}
+				case opcode::BELIEVES:
+				{
+					size_type operand = i.b;
+					//if f is false in any of the accessible worlds from the current one, then return false.
+					values.push_back(s.for_each_successor(agent_id{ i.a }, w, [&](size_type v)
+					{
+						return this->run(operand, s, world_id{ v }, proposition_bitset_state, ws);
+					}));
+					break;
+				}
+				case opcode::EVERYONE_BELIEVES:
+				{
+					node_id n{ i.a };
+					size_type operand = i.b;
+					size_type num_agents = this->nodes[n.id + 1].count;
+					size_type order = this->nodes[n.id + 2 + num_agents].count;
+
+					// Check 'f' in all worlds accessible from 'w' by 'agents' with distance at most 'order'.
+					// Distance classes are expanded as a whole: the next frontier is the union of the successor rows of the current one, minus the worlds already visited.
+					this->get_group(n.id + 2, num_agents, ws.group);
+					util::bit_matrix<> const & successors = s.get_joint_successors(ws.group);
+
+					if (!this->run(operand, s, w, proposition_bitset_state, ws))
+					{
+						values.push_back(false);
+						break;
+					}
+
+					util::bitset<> & visited = ws.acquire(s.num_worlds);
+					util::bitset<> & frontier = ws.acquire(s.num_worlds);
+					util::bitset<> & next_frontier = ws.acquire(s.num_worlds);
+					visited.clear(s.Wcs).set(s.Wcs, w.id, true);
+					frontier.clear(s.Wcs).set(s.Wcs, w.id, true);
+
+					bool holds = true;
+					for (size_type distance = 1; distance <= order && holds; ++distance)
+					{
+						next_frontier.clear(s.Wcs);
+						for (std::size_t v = frontier.find_first(s.Wcs); v < s.num_worlds; v = frontier.find_next(s.Wcs, v))
+						{
+							successors.row_union_into(s.Gcs, v, next_frontier);
+						}
+						next_frontier.inplace_difference(s.Wcs, visited);
+						if (next_frontier.none(s.Wcs)) break;
+
+						for (std::size_t v = next_frontier.find_first(s.Wcs); v < s.num_worlds && holds; v = next_frontier.find_next(s.Wcs, v))
+						{
+							holds = this->run(operand, s, world_id{ static_cast<size_type>(v) }, proposition_bitset_state, ws);
+						}
+
+						visited.inplace_union(s.Wcs, next_frontier);
+						std::swap(frontier, next_frontier);
+					}
+
+					ws.release(3);
+					values.push_back(holds);
+					break;
+				}
+				case opcode::COMMON_BELIEF:
+				{
+					node_id n{ i.a };
+					size_type operand = i.b;
+					size_type num_agents = this->nodes[n.id + 1].count;
+
+					// 'f' must hold in all worlds reachable from 'w' in one or more steps of the group's accessibility relations.
+					this->get_group(n.id + 2, num_agents, ws.group);
+					util::bit_matrix<> const & closure = s.get_common_belief_closure(ws.group);
+					values.push_back(closure.for_each_in_row(s.Gcs, w.id, [&](size_type v)
+					{
+						return this->run(operand, s, world_id{ v }, proposition_bitset_state, ws);
+					}));
+					break;
+				}
+				case opcode::RETURN:
+				{
+					bool result = values.back();
+					values.pop_back();
+					return result;
+				}
+			}
+		}
+	}
+
+	formula::world_set formula::evaluate_all(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state) const
+	{
+		std::unordered_map<size_type, world_set> sets;
+		this->evaluate_all(s, n, proposition_bitset_state, sets);
+		return std::move(sets.extract(n.id).mapped());
+	}
+
+	formula::world_set const & formula::evaluate_all(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state, std::unordered_map<size_type, world_set> & sets) const
+	{
+		auto it = sets.find(n.id);
+		if (it == sets.end())
+		{
+			// References into an unordered_map stay valid as it grows, so subformulas can be kept by reference while evaluating n.
+			it = sets.emplace(n.id, this->evaluate_all_node(s, n, proposition_bitset_state, sets)).first;
+		}
+		return it->second;
+	}
+
+	formula::world_set formula::evaluate_all_node(state const & s, node_id n, util::bitset<>::common_state proposition_bitset_state, std::unordered_map<size_type, world_set> & sets) const
+	{
+		util::bitset<>::common_state const & wcs = s.Wcs;
+		world_set result(wcs);
+
 		switch (this->nodes[n.id].type)
 		{
 			case formula::formula_type::TOP:
 			{
-				return true;
+				return std::move(result.flip(wcs));
 			}
 			case formula::formula_type::BOT:
 			{
-				return false;
+				return result;
 			}
 			case formula::formula_type::PROP:
 			{
 				proposition_id p = this->nodes[n.id + 1].prop;
-				return s.get_valuation(w, p, proposition_bitset_state);
+				if (s.VT)
+				{
+					s.VT->row_copy_into(s.VTcs, p.id, result);
+					return result;
+				}
+				for (size_type w = 0; w < s.num_worlds; ++w)
+				{
+					if (s.get_valuation(world_id{ w }, p, proposition_bitset_state)) result.set(wcs, w, true);
+				}
+				return result;
+			}
+			case formula::formula_type::ATTENTION:
+			{
+				agent_id a = this->nodes[n.id + 1].agent;
+				proposition_id p = this->nodes[n.id + 2].prop;
+				if (s.VT)
+				{
+					s.VT->row_copy_into(s.VTcs, get_attention_proposition(a, p, proposition_bitset_state).id, result);
+					return result;
+				}
+				for (size_type w = 0; w < s.num_worlds; ++w)
+				{
+					if (s.get_attention(world_id{ w }, a, p, proposition_bitset_state)) result.set(wcs, w, true);
+				}
+				return result;
 			}
 			case formula::formula_type::NOT:
 			{
-				node_id f = this->nodes[n.id + 1].nid; //next component of logical formula is evaluated
-				return !this->evaluate(s, w, f, proposition_bitset_state);
+				node_id f = this->nodes[n.id + 1].nid;
+				result.copy(wcs, this->evaluate_all(s, f, proposition_bitset_state, sets));
+				return std::move(result.flip(wcs));
 			}
 			case formula::formula_type::AND:
 			{
+				result.flip(wcs);
 				size_type count = this->nodes[n.id + 1].count;
-				for (size_type i = 0; i < count; ++i)
+				for (size_type i = 0; i < count && !result.none(wcs); ++i)
 				{
 					node_id conjunct = this->nodes[n.id + 2 + i].nid;
-					if (!this->evaluate(s, w, conjunct, proposition_bitset_state))
+					if (s.VT && this->nodes[conjunct.id].type == formula_type::PROP)
+					{
+						// Propositions intersect directly with their row, e.g. a conjunction of attention propositions costs one pass per conjunct.
+						s.VT->row_intersection_into(s.VTcs, this->nodes[conjunct.id + 1].prop.id, result);
+						continue;
+					}
+					if (s.VT && this->nodes[conjunct.id].type == formula_type::ATTENTION)
 					{
-						return false;
+						proposition_id p = get_attention_proposition(this->nodes[conjunct.id + 1].agent, this->nodes[conjunct.id + 2].prop, proposition_bitset_state);
+						s.VT->row_intersection_into(s.VTcs, p.id, result);
+						continue;
 					}
+					result.inplace_intersection(wcs, this->evaluate_all(s, conjunct, proposition_bitset_state, sets));
 				}
-				return true;
+				return result;
 			}
 			case formula::formula_type::OR:
 			{
@@ -156,29 +653,22 @@ namespace del
 				for (size_type i = 0; i < count; ++i)
 				{
 					node_id disjunct = this->nodes[n.id + 2 + i].nid;
-					if (this->evaluate(s, w, disjunct, proposition_bitset_state))
-					{
-						return true;
-					}
+					result.inplace_union(wcs, this->evaluate_all(s, disjunct, proposition_bitset_state, sets));
 				}
-				return false;
+				return result;
 			}
 			case formula::formula_type::BELIEVES:
 			{
 				agent_id a = this->nodes[n.id + 1].agent;
 				node_id f = this->nodes[n.id + 2].nid;
+				world_set const & sat = this->evaluate_all(s, f, proposition_bitset_state, sets);
 
-				for (size_type vid = 0; vid < s.num_worlds; ++vid)
+				// B_a f holds at w iff every world a accesses from w satisfies f.
+				for (size_type w = 0; w < s.num_worlds; ++w)
 				{
-					world_id v{ vid };
-
-					//if f is false in any of the accessible worlds from the current one, then return false.
-					if (s.get_accessible(a, w, v) && !this->evaluate(s, v, f, proposition_bitset_state))
-					{
-						return false;
-					}
+					if (s.R.row_is_subset_of(s.Rcs, s.get_row(a, world_id{ w }), sat)) result.set(wcs, w, true);
 				}
-				return true;
+				return result;
 			}
 			case formula::formula_type::EVERYONE_BELIEVES:
 			{
@@ -186,71 +676,43 @@ namespace del
 				size_type order = this->nodes[n.id + 2 + num_agents].count;
 				node_id f = this->nodes[n.id + 2 + num_agents + 1].nid;
 
-				// TODO: This could be more efficient for many agents if we calculated union of all in one pass.
-				// TODO: Could save allocations by not having local workspace if we evaluate this often.
-				util::bitset<> joint_R(s.Rcs);
-				for (size_type a = 0; a < num_agents; ++a)
-				{
-					joint_R.inplace_union(s.Rcs, s.R[this->nodes[n.id + 2 + a].agent.id]);
-				}
-
-				// Check 'f' in all worlds accessible from 'w' by 'agents' with distance at most 'order'.
-				// TODO: Could save allocations by not having local workspace if we evaluate this often.
-				// BFS for reachable worlds, quadratic complexity because we can't efficiently iterate over accessible neighbors in bitsets.
-				// Could perhaps do iterated union of accessible worlds instead of BFS; though this requires splitting joint_R into array of bitsets for each world (currently tightly packed).
-				util::bitset<>::common_state vcs(s.num_worlds);
-				util::bitset<> visited(vcs);
-
-				// TODO: Vectors galore...
-				std::vector<world_id> queue;
-				queue.reserve(s.num_worlds);
-				std::vector<world_id> next_queue;
-				next_queue.reserve(s.num_worlds);
-
-				size_type current_distance_class = 0;
-				visited.set(vcs, w.id, true);
-				queue.push_back(w);
-
-				while (current_distance_class < order)
-				{
-					for (world_id v : queue)
-					{
-						if (!this->evaluate(s, v, f, proposition_bitset_state))
-						{
-							return false;
-						}
-
-						for (size_type v2 = 0; v2 < s.num_worlds; ++v2)
-						{
-							if (joint_R.get(s.Rcs, v.id * s.num_worlds + v2) && !visited.get(vcs, v2))
-							{
-								visited.set(vcs, v2, true);
-								next_queue.emplace_back(world_id{ v2 });
-							}
-						}
-					}
+				std::vector<size_type> group;
+				this->get_group(n.id + 2, num_agents, group);
+				util::bit_matrix<> const & successors = s.get_joint_successors(group);
 
-					std::swap(queue, next_queue);
-					next_queue.clear();
-					++current_distance_class;
-				}
-				for (world_id v : queue)
+				// 'f' must hold in all worlds within distance 'order'; each round keeps the worlds whose successors all survived the previous round.
+				result.copy(wcs, this->evaluate_all(s, f, proposition_bitset_state, sets));
+				world_set next(wcs);
+				for (size_type i = 0; i < order; ++i)
 				{
-					if (!this->evaluate(s, v, f, proposition_bitset_state))
+					next.copy(wcs, result);
+					for (size_type w = 0; w < s.num_worlds; ++w)
 					{
-						return false;
+						if (result.get(wcs, w) && !successors.row_is_subset_of(s.Gcs, w, result)) next.set(wcs, w, false);
 					}
+					if (next.equals(wcs, result)) break;
+					std::swap(result, next);
 				}
-
-				return true;
+				return result;
 			}
-			case formula::formula_type::COMMON_BELIEF: /*Common Belief not implemented */
+			case formula::formula_type::COMMON_BELIEF:
 			{
-				// TODO: Implement.
-				throw std::runtime_error("not implemented");
+				size_type num_agents = this->nodes[n.id + 1].count;
+				node_id f = this->nodes[n.id + 2 + num_agents].nid;
+				world_set const & sat = this->evaluate_all(s, f, proposition_bitset_state, sets);
+
+				// C_G f holds at w iff every world reachable from w through the group's relations satisfies f.
+				std::vector<size_type> group;
+				this->get_group(n.id + 2, num_agents, group);
+				util::bit_matrix<> const & closure = s.get_common_belief_closure(group);
+				for (size_type w = 0; w < s.num_worlds; ++w)
+				{
+					if (closure.row_is_subset_of(s.Gcs, w, sat)) result.set(wcs, w, true);
+				}
+				return result;
 			}
 			case formula::formula_type::EMPTY:
-				return false; // Treat EMPTY as invalid
+				return result; // Treat EMPTY as invalid
 		}
 
 #if defined(_MSC_VER)
@@ -279,6 +741,12 @@ namespace del
 			proposition_id p = this->nodes[n.id + 1].prop;
 			return d.get_proposition_name(p);
 		}
+		case formula::formula_type::ATTENTION:
+		{
+			agent_id a = this->nodes[n.id + 1].agent;
+			proposition_id p = this->nodes[n.id + 2].prop;
+			return "ATTENTION[" + d.get_agent_name(a) + "](" + d.get_proposition_name(p) + ")";
+		}
 		case formula::formula_type::NOT:
 		{
 			node_id f = this->nodes[n.id + 1].nid;
@@ -331,8 +799,19 @@ namespace del
 		}
 		case formula::formula_type::COMMON_BELIEF:
 		{
-			// TODO: Implement.
-			throw std::runtime_error("not implemented");
+			std::stringstream buffer;
+			buffer << "COMMON_BELIEF[";
+			size_type num_agents = this->nodes[n.id + 1].count;
+			for (size_type a = 0; a < num_agents; ++a)
+			{
+				if (a != 0) buffer << ",";
+				buffer << d.get_agent_name(this->nodes[n.id + 2 + a].agent);
+			}
+			node_id f = this->nodes[n.id + 2 + num_agents].nid;
+
+			buffer << "](" << this->to_string(d, f) << ")";
+
+			return buffer.str();
 		}
 		case formula::formula_type::EMPTY:
 				return "EMPTY"; // Treat EMPTY as invalid
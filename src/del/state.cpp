@@ -1,204 +1,940 @@
 #include "del/state.hpp"
 
 #include "del/action.hpp"
+#include "del/attention.hpp"
 #include "del/formula.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream> 
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
 
 
 namespace del
 {
+	namespace
+	{
+		// Sets of worlds satisfying formulas of an action, each formula and each shared subformula evaluated only once by formula::evaluate_all.
+		class satisfaction_cache
+		{
+		public:
+			satisfaction_cache(state const & s, formula const & f, util::bitset<>::common_state proposition_bitset_state) :
+				s(s), f(f), proposition_bitset_state(proposition_bitset_state), sets()
+			{
+			}
+
+			formula::world_set const & get(formula::node_id n)
+			{
+				return this->f.evaluate_all(this->s, n, this->proposition_bitset_state, this->sets);
+			}
+
+		private:
+			state const & s;
+			formula const & f;
+			util::bitset<>::common_state proposition_bitset_state;
+			std::unordered_map<size_type, formula::world_set> sets;
+		};
+	}
+
 	state::state(size_type num_agents, size_type num_worlds, util::bitset<>::common_state proposition_bitset_state) :
+		state(num_agents, num_worlds, proposition_bitset_state, uninitialized_tag{})
+	{
+		/* Accessibility starts out empty, and every world with an empty valuation of its own, to be set by the domain. */
+		std::fill_n(this->storage.get(), this->get_storage_size(), std::size_t{ 0 });
+
+		for (auto [part, cs] : { std::pair{ &this->V, proposition_bitset_state }, std::pair{ &this->VA, this->Acs } })
+		{
+			part->store->sets.reserve(cs, num_worlds);
+			for (size_type w = 0; w < num_worlds; ++w)
+			{
+				part->store->sets.push_back(cs);
+				part->ids[w] = valuation_id{ w };
+			}
+		}
+	}
+
+	state::state(size_type num_agents, size_type num_worlds, util::bitset<>::common_state proposition_bitset_state, uninitialized_tag) :
 		num_worlds(num_worlds),
-		Rcs(num_worlds * num_worlds), R(), V() 
-		// TODO: Hack to eliminate unreachable worlds propagating by ignoring them in the next product update. Replace by bisimulation contraction or similar model reduction.
-		, reachable_worlds_cs(num_worlds), reachable_worlds(reachable_worlds_cs) //DOUBT: still not sure how these two work
+		Wcs(num_worlds), Rcs(num_agents * num_worlds, num_worlds), Gcs(num_worlds, num_worlds),
+		storage(new std::size_t[this->get_storage_size()]),
+		R(storage.get()),
+		Acs(get_attention_bitset_state(num_agents, proposition_bitset_state)),
+		V{ std::make_shared<valuation_store>(), std::vector<valuation_id>(num_worlds) },
+		VA{ std::make_shared<valuation_store>(), std::vector<valuation_id>(num_worlds) },
+		VTcs(proposition_bitset_state.get_size() * (1 + num_agents), num_worlds), VT(), group_relations(), formula_results()
+		// NB! R points into storage, so declaration order is important.
 	{
+	}
 
-		/* Space for the Accessibility relations at the state */
-		this->R.reserve(num_agents);
-		for (size_type a = 0; a < num_agents; ++a)
+	std::size_t state::get_storage_size() const
+	{
+		return util::bit_matrix<>::get_num_blocks(this->Rcs);
+	}
+
+	state state::product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const
+	{
+		state result = a.factored
+			? this->factored_product_update(a, num_agents, proposition_bitset_state, contract, ws)
+			: this->explicit_product_update(a, num_agents, proposition_bitset_state, contract, ws);
+
+		if (this->VT)
 		{
-			this->R.emplace_back(this->Rcs);
+			result.build_transposed_valuation(proposition_bitset_state);
 		}
 
-		/* Valuation Functions at the state */
-		this->V.reserve(num_worlds);
-		for (size_type w = 0; w < num_worlds; ++w)
+		// The successor holds its valuations as deltas against those of this state, which can be recomputed from now on.
+		for (auto [part, result_part] : { std::pair{ &this->V, &result.V }, std::pair{ &this->VA, &result.VA } })
 		{
-			this->V.emplace_back(proposition_bitset_state);
+			if (result_part->store->base == part->store)
+			{
+				release(*part->store);
+			}
 		}
+		return result;
 	}
 
-	state state::product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state) const
+	state state::explicit_product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const
 	{
+		satisfaction_cache sat(*this, *a.formulas, proposition_bitset_state);
+
 		// current state worlds and action events 
-		std::vector<std::pair<world_id, event_id>> new_worlds; // TODO: This vector workspace could/should be external if product update is in hot path.
+		std::vector<std::pair<world_id, event_id>> & new_worlds = ws.product_worlds;
+		new_worlds.clear();
 
 		/* For each world at the current state, evaluate which events are possible
 			and if it's, create world */
 		for (size_type w = 0; w < this->num_worlds; ++w)
 		{
 			world_id w_id{ w }; // current state world
-			//std::cout<< "reachable : " << this->reachable_worlds.get(this->reachable_worlds_cs, w) <<"\n";
 			for (size_type e = 0; e < a.num_events; ++e)
 			{
 				event_id e_id{ e };
+				formula::node_id pre = a.get_pre(e_id);
 
-				// evaluate if this world at this current state fulfills preconditions for event e_id
-				if (a.formulas.evaluate(*this, w_id, a.get_pre(e_id), proposition_bitset_state)) 
+				// evaluate if this world at this current state fulfills preconditions for event e_id; constant ones are not evaluated
+				if (a.formulas->is_bot(pre)) continue;
+				if (a.formulas->is_top(pre) || sat.get(pre).get(this->Wcs, w)) 
 				{
-					// TODO: Hack to eliminate unreachable worlds propagating by ignoring them in the next product update. Replace by bisimulation contraction or similar model reduction.
 					//std::cout<< "World: " << w_id.id << "| Event: "<< e_id.id<< "\n";
 
-					if (!this->reachable_worlds.get(this->reachable_worlds_cs, w))
-					{
-						continue; 
-					}
-
 					new_worlds.emplace_back(w_id, e_id); // add pairs <new world, event>
 				}
 			}
 		}
 
-		// TODO: New constructor which doesn't make empty bitsets first, but does the copy+del+add in one pass (constructor).
-		// We could check if the optimizer is smart enough already, but it's probably not an automatically deducible optimization.
-		state new_state(num_agents, static_cast<size_type>(new_worlds.size()), proposition_bitset_state);
+		// Every valuation and row of the new state is written exactly once below, so its storage isn't zeroed first.
+		state new_state(num_agents, static_cast<size_type>(new_worlds.size()), proposition_bitset_state, uninitialized_tag{});
+		new_state.derive_valuations(*this);
 		
 		//std::cout << "\nNew Worlds size: " << new_worlds.size() <<" | Old Worlds Size: "<< this->num_worlds << " \n";
 
-		
-		for(auto world : new_worlds)
+		// Index of the new world (v, f), if it exists, at v * num_events + f.
+		constexpr size_type no_world = static_cast<size_type>(-1);
+		std::vector<size_type> & new_world_index = ws.product_world_index;
+		new_world_index.assign(static_cast<std::size_t>(this->num_worlds) * a.num_events, no_world);
+		for (size_type nw = 0; nw < new_state.num_worlds; ++nw)
 		{
-			//std::cout<< "\nWorld: " << world.first.id << "| Event: "<< world.second.id;
+			auto const &[v_id, f_id] = new_worlds[nw];
+			new_world_index[static_cast<std::size_t>(v_id.id) * a.num_events + f_id.id] = nw;
+		}
+
+		/*
+			Truth table of the event accessibility formulas.
+			Whether (w, e) -> (v, f) is accessible for an agent depends on the formula Q(agent, e, f) evaluated at w only, so the table is filled from the satisfying world set of each formula instead of evaluating per pair of new worlds.
+			The conditions of (nw1, agent) start at table_offset[nw1 * num_agents + agent], in the order of action::get_accessible_events.
+		*/
+		std::vector<std::size_t> & table_offset = ws.table_offset;
+		table_offset.assign(static_cast<std::size_t>(new_state.num_worlds) * num_agents + 1, 0);
+		for (size_type nw1 = 0; nw1 < new_state.num_worlds; ++nw1)
+		{
+			for (size_type agent = 0; agent < num_agents; ++agent)
+			{
+				std::size_t i = static_cast<std::size_t>(nw1) * num_agents + agent;
+				table_offset[i + 1] = table_offset[i] + a.get_accessible_events(agent_id{ agent }, new_worlds[nw1].second).size();
+			}
+		}
+
+		/*
+			Valuations of the new worlds, interned: each part of the valuation of (w, e) only depends on that part of the valuation of w and on e, so it is derived once per such pair.
+		*/
+		for (auto [part, interning] : { std::pair{ &this->V, &ws.base_interning }, std::pair{ &this->VA, &ws.attention_interning } })
+		{
+			interning->memo.assign(static_cast<std::size_t>(get_num_valuations(*part)) * a.num_events, no_valuation);
+			interning->index.clear();
+		}
+
+		util::bitset<>::common_state event_accessible_cs(table_offset.back());
+		util::bitset<> & event_accessible = ws.acquire(static_cast<size_type>(table_offset.back()));
+		event_accessible.clear(event_accessible_cs);
+		for (size_type nw1 = 0; nw1 < new_state.num_worlds; ++nw1)
+		{
+			auto const &[w_id, e_id] = new_worlds[nw1];
+			for (size_type agent = 0; agent < num_agents; ++agent)
+			{
+				std::size_t offset = table_offset[static_cast<std::size_t>(nw1) * num_agents + agent];
+				auto const & accessible_events = a.get_accessible_events(agent_id{ agent }, e_id);
+				for (std::size_t k = 0; k < accessible_events.size(); ++k)
+				{
+					formula::node_id condition = accessible_events[k].condition;
+					if (a.formulas->is_top(condition) || sat.get(condition).get(this->Wcs, w_id.id))
+					{
+						event_accessible.set(event_accessible_cs, offset + k, true);
+					}
+				}
+			}
 		}
-		
 
 		for (size_type nw1 = 0; nw1 < new_state.num_worlds; ++nw1)
 		{
 			auto const &[w_id, e_id] = new_worlds[nw1]; //nw1 is result of w_id world from former state with e_id event consequences
 
-			// Valuation.
-			new_state.V[nw1]
-				.copy(proposition_bitset_state, this->V[w_id.id]) // copies the proposition valuation from the current state's world w_id.id into the new state's world nw1
-				.inplace_difference(proposition_bitset_state, a.post_del[e_id.id]) //  postcondition of the action that indicates which propositions should be set to false
-				.inplace_union(proposition_bitset_state, a.post_add[e_id.id]); // postcondition of the action that indicates which propositions should be set to true
+			// Valuation: the one of w_id in the current state, minus the propositions e_id sets to false, plus those it sets to true; attention changes apply to the attention matrix as a whole.
+			new_state.V.ids[nw1] = derive_valuation(new_state.V, this->V, this->V.ids[w_id.id], e_id, a.num_events,
+				a.get_post_del(e_id, proposition_bitset_state), a.get_post_add(e_id, proposition_bitset_state), proposition_bitset_state, ws.base_interning);
+			new_state.VA.ids[nw1] = derive_valuation(new_state.VA, this->VA, this->VA.ids[w_id.id], e_id, a.num_events,
+				a.get_attention_del(e_id), a.get_attention_add(e_id), this->Acs, ws.attention_interning);
 
 			// Accessibility.
 			for (size_type agent = 0; agent < num_agents; ++agent)
 			{
 				agent_id a_id{ agent };
-				
-				/*
-				std::cout<< "----------------------------";
-				std::cout<< "AGENT : "<< agent <<" \n";
-				std::cout<< "----------------------------";
-				*/
-
-				for (size_type nw2 = 0; nw2 < new_state.num_worlds; ++nw2)
+				new_state.clear_successors(a_id, world_id{ nw1 });
+				std::size_t offset = table_offset[static_cast<std::size_t>(nw1) * num_agents + agent];
+				auto const & accessible_events = a.get_accessible_events(a_id, e_id);
+
+				for (std::size_t k = 0; k < accessible_events.size(); ++k)
 				{
-					auto const &[v_id, f_id] = new_worlds[nw2]; //nw2 is result of v_id world from former state with f_id event consequences
-				
-					//std::cout<< "\nWorld: " << w_id.id << "| Event: "<< e_id.id<< "-->" << "World: " << v_id.id << "| Event: "<< f_id.id;
-					//std::cout<< "\nFormer worlds accessible :"<< this->get_accessible(a_id, w_id, v_id)<< "Events accessible: "<< a.formulas.evaluate(*this, w_id, a.get_accessible(a_id, e_id, f_id), proposition_bitset_state)<< "\n";
-					
-					/*
-					std::cout << "Agent: " << a_id.id << ", World: " << w_id.id 
-          			<< " -> World: " << v_id.id 
-          			<< ", Event: " << e_id.id << " -> Event: " << f_id.id
-          			<< ", Formula: " << a.formulas.to_string(d, a.get_accessible(a_id, e_id, f_id)) << "\n";
-					std::cout<< "\nFormer worlds accessible :"<< this->get_accessible(a_id, w_id, v_id)<< "Events accessible: "
-					<< a.formulas.evaluate(*this, w_id, a.get_accessible(a_id, e_id, f_id), proposition_bitset_state)<< " Sally is paying attention: "<<
-					(get_valuation(w_id, d.get_proposition_id("sally_is_paying_attention_to_marble_in_table"), proposition_bitset_state) ? "true" : "false") << "\n";
-					*/
-
-
-					if (this->get_accessible(a_id, w_id, v_id) && a.formulas.evaluate(*this, w_id, a.get_accessible(a_id, e_id, f_id), proposition_bitset_state))
+					if (!event_accessible.get(event_accessible_cs, offset + k)) continue;
+
+					event_id f_id = accessible_events[k].event;
+					this->for_each_successor(a_id, w_id, [&](size_type v)
 					{
 						/* new world 1 (nw1) -> new world 2 (nw2) if:
 							- respective worlds from former state also fulfill the access relation (w_id -> v_id)
 							- required formula for accessibility between events is true
+							- (v_id, f_id) survived its precondition
 						*/
-						
-						//std::cout<< "\nWorld: " << w_id.id << "| Event: "<< e_id.id<< "-->" << "World: " << v_id.id << "| Event: "<< f_id.id  ;
-						//std::cout<< "\nFormer worlds accessible :"<< this->get_accessible(a_id, w_id, v_id)<< "Events accessible: "<< a.formulas.evaluate(*this, w_id, a.get_accessible(a_id, e_id, f_id), proposition_bitset_state)<< "\n";
-						//std::cout<< " TRUE !\n";
-						//std::cout<<"##################################\n";
+						size_type nw2 = new_world_index[static_cast<std::size_t>(v) * a.num_events + f_id.id];
+						if (nw2 != no_world)
+						{
+							new_state.set_accessible(a_id, world_id{ nw1 }, world_id{ nw2 }, true);
+						}
+						return true;
+					});
+				}
+			}
+		}
+
+		ws.release(1);
 
-						new_state.set_accessible(a_id, world_id{ nw1 }, world_id{ nw2 }, true);
+		// Only the worlds reachable from the designated world matter, so the product is compacted before anything else sees it.
+		state compacted_state = new_state.compact(num_agents, proposition_bitset_state, ws);
+
+		if (contract)
+		{
+			return compacted_state.contract(num_agents, proposition_bitset_state, ws);
+		}
+
+		return compacted_state;
+	}
+
+	state state::factored_product_update(action const & a, size_type num_agents, util::bitset<>::common_state proposition_bitset_state, bool contract, workspace & ws) const
+	{
+		/*
+			The events of a factored action are the subsets of its touched propositions, represented as bitmasks.
+			Starting from the designated world paired with the full set, an agent at (w, full) accesses (v, the touched propositions it observes at w) for every v it accesses from w, and at (w, S) any other (v, S).
+			Since the subset an agent moves to depends on w alone, the product is expanded by BFS, only creating the reachable (world, subset) pairs.
+		*/
+		using event_mask = workspace::event_mask;
+
+		size_type num_touched = a.get_num_touched();
+		if (num_touched > 64) throw std::invalid_argument("Factored actions support at most 64 touched propositions.");
+		event_mask full_mask = num_touched == 64 ? ~event_mask(0) : (event_mask(1) << num_touched) - 1;
+
+		// Touched propositions observed by each agent in each world; (W x A) -> mask.
+		satisfaction_cache sat(*this, *a.formulas, proposition_bitset_state);
+		std::vector<event_mask> & observed = ws.observed;
+		observed.assign(static_cast<std::size_t>(this->num_worlds) * num_agents, 0);
+		for (size_type agent = 0; agent < num_agents; ++agent)
+		{
+			for (size_type t = 0; t < num_touched; ++t)
+			{
+				formula::node_id condition = a.get_observes(agent_id{ agent }, t);
+				if (a.formulas->is_bot(condition)) continue;
+
+				bool always = a.formulas->is_top(condition);
+				formula::world_set const * observes = always ? nullptr : &sat.get(condition);
+				for (size_type w = 0; w < this->num_worlds; ++w)
+				{
+					if (always || observes->get(this->Wcs, w))
+					{
+						observed[static_cast<std::size_t>(w) * num_agents + agent] |= event_mask(1) << t;
 					}
-				//	std::cout<<"##################################\n";
 				}
 			}
 		}
 
-		// TODO: Hack to eliminate unreachable worlds propagating by ignoring them in the next product update. Replace by bisimulation contraction or similar model reduction.
+		auto & new_worlds = ws.factored_worlds;
+		auto & new_world_index = ws.factored_world_index;
+		auto & edges = ws.edges;
+		new_worlds.clear();
+		new_world_index.clear();
+		edges.clear();
+
+		auto get_new_world = [&](size_type w, event_mask mask)
 		{
-			// Union of all accessibility relations.
-			util::bitset<> joint_R(new_state.Rcs);
-			for (size_type a = 0; a < num_agents; ++a)
+			auto [it, inserted] = new_world_index.try_emplace({ w, mask }, static_cast<size_type>(new_worlds.size()));
+			if (inserted) new_worlds.emplace_back(world_id{ w }, mask);
+			return it->second;
+		};
+
+		get_new_world(0, full_mask);
+		for (size_type nw1 = 0; nw1 < new_worlds.size(); ++nw1) // new_worlds doubles as the BFS queue.
+		{
+			auto [w_id, mask] = new_worlds[nw1];
+			for (size_type agent = 0; agent < num_agents; ++agent)
 			{
-				joint_R.inplace_union(new_state.Rcs, new_state.R[a]);
+				agent_id a_id{ agent };
+				event_mask target_mask = mask == full_mask ? observed[static_cast<std::size_t>(w_id.id) * num_agents + agent] : mask;
+
+				this->for_each_successor(a_id, w_id, [&](size_type v)
+				{
+					edges.push_back({ a_id, { nw1, get_new_world(static_cast<size_type>(v), target_mask) } });
+					return true;
+				});
 			}
+		}
+
+		// Edges are listed by source world, then agent, so each row of R is cleared and filled in one go.
+		state new_state(num_agents, static_cast<size_type>(new_worlds.size()), proposition_bitset_state, uninitialized_tag{});
+		new_state.derive_valuations(*this);
+
+		// Valuations are interned as in the unfactored product update, each part derived once per (old valuation, subset of the touched propositions in that part).
+		std::array<std::size_t, 64> touched_bit; // Of each touched proposition in its part.
+		event_mask touched_attention = 0;
+		for (size_type t = 0; t < num_touched; ++t)
+		{
+			proposition_id p = a.touched[t].prop;
+			if (is_attention_proposition(p, proposition_bitset_state))
+			{
+				auto [agent, q] = split_attention_proposition(p, proposition_bitset_state);
+				touched_bit[t] = get_attention_bit(agent, q, proposition_bitset_state);
+				touched_attention |= event_mask(1) << t;
+			}
+			else
+			{
+				touched_bit[t] = p.id;
+			}
+		}
 
-			// BFS from designated world.
-			std::vector<size_type> queue;
-			queue.reserve(new_state.num_worlds);
-			std::vector<size_type> next_queue;
-			next_queue.reserve(new_state.num_worlds);
+		struct touched_part
+		{
+			valuation_part & part;
+			valuation_part const & from;
+			util::bitset<>::common_state cs;
+			workspace::valuation_interning & interning;
+			event_mask touched;
+		};
+		touched_part parts[] = {
+			{ new_state.V, this->V, proposition_bitset_state, ws.base_interning, full_mask & ~touched_attention },
+			{ new_state.VA, this->VA, this->Acs, ws.attention_interning, touched_attention }
+		};
+		for (touched_part & p : parts)
+		{
+			p.interning.factored_memo.clear();
+			p.interning.index.clear();
+		}
 
-			new_state.reachable_worlds.set(new_state.reachable_worlds_cs, 0, true);
-			queue.push_back(0);
+		std::size_t next_edge = 0;
+		for (size_type nw = 0; nw < new_state.num_worlds; ++nw)
+		{
+			auto const & [w_id, mask] = new_worlds[nw];
 
-			while (!queue.empty())
+			for (touched_part & p : parts)
 			{
-				for (size_type w : queue)
+				valuation_id v = p.from.ids[w_id.id];
+				event_mask changes = mask & p.touched;
+				auto [memo, inserted] = p.interning.factored_memo.try_emplace({ v.id, changes }, no_valuation);
+				if (inserted)
 				{
-					for (size_type v = 0; v < new_state.num_worlds; ++v)
+					auto valuation = p.part.store->sets.push_back(p.cs);
+					valuation.copy(p.cs, get_valuation(p.from, w_id, p.cs));
+
+					// Deletions before additions, as in the unfactored product update.
+					for (bool value : { false, true })
 					{
-						if (joint_R.get(new_state.Rcs, w * new_state.num_worlds + v) && !new_state.reachable_worlds.get(new_state.reachable_worlds_cs, v))
+						for (size_type t = 0; t < num_touched; ++t)
 						{
-							new_state.reachable_worlds.set(new_state.reachable_worlds_cs, v, true);
-							next_queue.emplace_back(v);
+							if ((changes >> t) & 1 && a.touched[t].value == value)
+							{
+								valuation.set(p.cs, touched_bit[t], value);
+							}
 						}
 					}
+					valuation_id id = intern_last_valuation(p.part, p.cs, p.interning);
+					record_valuation_delta(p.part, id, p.from, v, p.cs);
+					memo->second = id.id;
 				}
+				p.part.ids[nw] = valuation_id{ memo->second };
+			}
 
-				std::swap(queue, next_queue);
-				next_queue.clear();
+			for (size_type agent = 0; agent < num_agents; ++agent)
+			{
+				new_state.clear_successors(agent_id{ agent }, world_id{ nw });
+				for (; next_edge < edges.size() && edges[next_edge].second.first == nw && edges[next_edge].first.id == agent; ++next_edge)
+				{
+					new_state.set_accessible(agent_id{ agent }, world_id{ nw }, world_id{ edges[next_edge].second.second }, true);
+				}
 			}
 		}
 
+		// Everything is reachable by construction, so no compaction is needed.
+		if (contract)
+		{
+			return new_state.contract(num_agents, proposition_bitset_state, ws);
+		}
+
 		return new_state;
 	}
+
+	state state::compact(size_type num_agents, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const
+	{
+		// BFS from designated world, one distance class at a time: the next frontier is the union of the successor rows of the current one.
+		util::bitset<> & reachable = ws.acquire(this->num_worlds);
+		util::bitset<> & frontier = ws.acquire(this->num_worlds);
+		util::bitset<> & next_frontier = ws.acquire(this->num_worlds);
+		reachable.clear(this->Wcs);
+		frontier.clear(this->Wcs);
+
+		reachable.set(this->Wcs, 0, true);
+		frontier.set(this->Wcs, 0, true);
+
+		while (!frontier.none(this->Wcs))
+		{
+			next_frontier.clear(this->Wcs);
+			for (std::size_t w = frontier.find_first(this->Wcs); w < this->num_worlds; w = frontier.find_next(this->Wcs, w))
+			{
+				for (size_type a = 0; a < num_agents; ++a)
+				{
+					this->R.row_union_into(this->Rcs, this->get_row(agent_id{ a }, world_id{ static_cast<size_type>(w) }), next_frontier);
+				}
+			}
+			next_frontier.inplace_difference(this->Wcs, reachable);
+			reachable.inplace_union(this->Wcs, next_frontier);
+			std::swap(frontier, next_frontier);
+		}
+
+		// Renumber the reachable worlds densely, preserving their order; world 0 is reachable and stays first.
+		constexpr size_type unreachable = static_cast<size_type>(-1);
+		std::vector<size_type> & new_index = ws.new_index;
+		std::vector<size_type> & old_index = ws.old_index;
+		new_index.assign(this->num_worlds, unreachable);
+		old_index.clear();
+		for (size_type w = 0; w < this->num_worlds; ++w)
+		{
+			if (reachable.get(this->Wcs, w))
+			{
+				new_index[w] = static_cast<size_type>(old_index.size());
+				old_index.push_back(w);
+			}
+		}
+		ws.release(3);
+
+		state compacted(num_agents, static_cast<size_type>(old_index.size()), proposition_bitset_state, uninitialized_tag{});
+		compacted.share_valuation_base(*this);
+		ws.base_interning.memo.assign(get_num_valuations(this->V), no_valuation);
+		ws.attention_interning.memo.assign(get_num_valuations(this->VA), no_valuation);
+		for (size_type nw = 0; nw < compacted.num_worlds; ++nw)
+		{
+			world_id w{ old_index[nw] };
+			compacted.copy_valuation(world_id{ nw }, *this, w, proposition_bitset_state, ws);
+
+			for (size_type a = 0; a < num_agents; ++a)
+			{
+				agent_id a_id{ a };
+				compacted.clear_successors(a_id, world_id{ nw });
+				this->for_each_successor(a_id, w, [&](size_type v)
+				{
+					compacted.set_accessible(a_id, world_id{ nw }, world_id{ new_index[v] }, true); // Successors of reachable worlds are reachable.
+					return true;
+				});
+			}
+		}
+
+		return compacted;
+	}
+
+	state state::contract(size_type num_agents, util::bitset<>::common_state proposition_bitset_state, workspace & ws) const
+	{
+		/*
+			Bisimulation contraction by partition refinement.
+			Worlds start out in blocks of equal valuation, and blocks are split by the signature (own block, {(agent, successor block)}) until no block splits anymore.
+			Blocks are numbered in order of their first world, so the designated world 0 always ends up in block 0.
+		*/
+		std::vector<size_type> & block = ws.block;
+		block.resize(this->num_worlds);
+		size_type num_blocks = 0;
+
+		// Initial partition: equal valuations, i.e. equal pairs of valuation ids as valuations are interned.
+		{
+			auto & valuation_block = ws.valuation_block;
+			valuation_block.clear();
+
+			for (size_type w = 0; w < this->num_worlds; ++w)
+			{
+				auto [it, inserted] = valuation_block.try_emplace({ this->V.ids[w].id, this->VA.ids[w].id }, num_blocks);
+				if (inserted) ++num_blocks;
+				block[w] = it->second;
+			}
+		}
+
+		// Refinement: split blocks until stable. Every round either increases the number of blocks or terminates.
+		std::vector<size_type> & signature = ws.signature;
+		std::vector<size_type> & next_block = ws.next_block;
+		next_block.resize(this->num_worlds);
+		while (true)
+		{
+			// Signatures of the new blocks, kept in the workspace across rounds; a block is found by the hash of its signature, then compared in full.
+			auto & signatures = ws.signatures;
+			auto & signature_offset = ws.signature_offset;
+			auto & signature_index = ws.signature_index;
+			signatures.clear();
+			signature_offset.assign(1, 0);
+			signature_index.clear();
+
+			for (size_type w = 0; w < this->num_worlds; ++w)
+			{
+				signature.clear();
+				signature.push_back(block[w]);
+				for (size_type a = 0; a < num_agents; ++a)
+				{
+					size_type begin = static_cast<size_type>(signature.size());
+					this->for_each_successor(agent_id{ a }, world_id{ w }, [&](size_type v)
+					{
+						signature.push_back(block[v]);
+						return true;
+					});
+					std::sort(signature.begin() + begin, signature.end());
+					signature.erase(std::unique(signature.begin() + begin, signature.end()), signature.end());
+					signature.push_back(static_cast<size_type>(-1)); // Separates the agents.
+				}
+
+				std::size_t h = 0;
+				for (size_type x : signature) util::hash_combine(h, x);
+
+				size_type found = static_cast<size_type>(-1);
+				auto [begin, end] = signature_index.equal_range(h);
+				for (auto it = begin; it != end; ++it)
+				{
+					std::size_t first = signature_offset[it->second];
+					std::size_t last = signature_offset[it->second + 1];
+					if (last - first == signature.size() && std::equal(signature.begin(), signature.end(), signatures.begin() + first))
+					{
+						found = it->second;
+						break;
+					}
+				}
+				if (found == static_cast<size_type>(-1))
+				{
+					found = static_cast<size_type>(signature_offset.size() - 1);
+					signatures.insert(signatures.end(), signature.begin(), signature.end());
+					signature_offset.push_back(signatures.size());
+					signature_index.emplace(h, found);
+				}
+				next_block[w] = found;
+			}
+
+			size_type num_next_blocks = static_cast<size_type>(signature_offset.size() - 1);
+			std::swap(block, next_block);
+			if (num_next_blocks == num_blocks) break;
+			num_blocks = num_next_blocks;
+		}
+
+		// Quotient model: one world per block, taking valuation and successors from the first world of the block.
+		std::vector<size_type> & representative = ws.representative;
+		representative.assign(num_blocks, static_cast<size_type>(-1));
+		for (size_type w = 0; w < this->num_worlds; ++w)
+		{
+			if (representative[block[w]] == static_cast<size_type>(-1)) representative[block[w]] = w;
+		}
+
+		state quotient(num_agents, num_blocks, proposition_bitset_state, uninitialized_tag{});
+		quotient.share_valuation_base(*this);
+		ws.base_interning.memo.assign(get_num_valuations(this->V), no_valuation);
+		ws.attention_interning.memo.assign(get_num_valuations(this->VA), no_valuation);
+		for (size_type b = 0; b < num_blocks; ++b)
+		{
+			world_id w{ representative[b] };
+			quotient.copy_valuation(world_id{ b }, *this, w, proposition_bitset_state, ws);
+
+			for (size_type a = 0; a < num_agents; ++a)
+			{
+				agent_id a_id{ a };
+				quotient.clear_successors(a_id, world_id{ b });
+				this->for_each_successor(a_id, w, [&](size_type v)
+				{
+					quotient.set_accessible(a_id, world_id{ b }, world_id{ block[v] }, true);
+					return true;
+				});
+			}
+		}
+
+		return quotient;
+	}
+
+	void state::build_transposed_valuation(util::bitset<>::common_state proposition_bitset_state)
+	{
+		util::bit_matrix<> & VT = this->VT.emplace(this->VTcs);
+		std::size_t num_base = proposition_bitset_state.get_size();
+		std::size_t row_size = proposition_bitset_state.get_aligned_size();
+		for (size_type w = 0; w < this->num_worlds; ++w)
+		{
+			auto valuation = this->get_valuation(world_id{ w }, proposition_bitset_state);
+			for (std::size_t p = valuation.find_first(proposition_bitset_state); p < num_base; p = valuation.find_next(proposition_bitset_state, p))
+			{
+				VT.set(this->VTcs, p, w, true);
+			}
+
+			// Bit i of the attention matrix is agent i / row_size attending to base proposition i % row_size, i.e. attention proposition P + (i / row_size) * P + i % row_size.
+			auto attention = get_valuation(this->VA, world_id{ w }, this->Acs);
+			for (std::size_t i = attention.find_first(this->Acs); i < this->Acs.get_size(); i = attention.find_next(this->Acs, i))
+			{
+				VT.set(this->VTcs, num_base + (i / row_size) * num_base + i % row_size, w, true);
+			}
+		}
+	}
+
+	bool state::has_transposed_valuation() const
+	{
+		return this->VT.has_value();
+	}
+
 	bool state::get_prop_valuation_actual_world(proposition_id p, util::bitset<>::common_state proposition_bitset_state) const
 	{
 		world_id actual_w{0};
 		return this->get_valuation(actual_w,p, proposition_bitset_state);
 	}
-	bool state::get_reachable_world_boolean(size_type w) const
+
+	bool state::get_valuation(world_id w, proposition_id p, util::bitset<>::common_state proposition_bitset_state) const
+	{
+		if (is_attention_proposition(p, proposition_bitset_state))
+		{
+			auto [a, q] = split_attention_proposition(p, proposition_bitset_state);
+			return this->get_attention(w, a, q, proposition_bitset_state);
+		}
+		return this->get_valuation(w, proposition_bitset_state).get(proposition_bitset_state, p.id);
+	}
+
+	util::bitset<>::const_span state::get_valuation(world_id w, util::bitset<>::common_state proposition_bitset_state) const
 	{
-		return this->reachable_worlds.get(this->reachable_worlds_cs, w);
+		return get_valuation(this->V, w, proposition_bitset_state);
 	}
 
-	bool state::get_valuation(world_id w, proposition_id p, util::bitset<>::common_state proposition_bitset_state) const
+	bool state::get_attention(world_id w, agent_id a, proposition_id p, util::bitset<>::common_state proposition_bitset_state) const
 	{
-		return this->V[w.id].get(proposition_bitset_state, p.id);
+		return get_valuation(this->VA, w, this->Acs).get(this->Acs, get_attention_bit(a, p, proposition_bitset_state));
 	}
 
 	void state::set_valuation(world_id w, proposition_id p, bool v, util::bitset<>::common_state proposition_bitset_state)
 	{
-		this->V[w.id].set(proposition_bitset_state, p.id, v);
+		if (is_attention_proposition(p, proposition_bitset_state))
+		{
+			auto [a, q] = split_attention_proposition(p, proposition_bitset_state);
+			this->VA.store->sets.at(this->Acs, this->VA.ids[w.id].id).set(this->Acs, get_attention_bit(a, q, proposition_bitset_state), v);
+			return;
+		}
+		this->V.store->sets.at(proposition_bitset_state, this->V.ids[w.id].id).set(proposition_bitset_state, p.id, v);
+	}
+
+	valuation_id state::intern_last_valuation(valuation_part & part, util::bitset<>::common_state cs, workspace::valuation_interning & interning)
+	{
+		util::bitset_vector<> const & valuations = part.store->sets;
+		size_type last = static_cast<size_type>(valuations.size() - 1);
+		auto valuation = valuations.at(cs, last);
+
+		std::size_t h = valuation.get_hash(cs);
+		auto [first, end] = interning.index.equal_range(h);
+		auto it = std::find_if(first, end, [&](auto const & entry) { return valuations.at(cs, entry.second).equals(cs, valuation); });
+		if (it != end)
+		{
+			part.store->sets.pop_back(cs);
+			return valuation_id{ it->second };
+		}
+
+		interning.index.emplace(h, last);
+		return valuation_id{ last };
+	}
+
+	valuation_id state::derive_valuation(valuation_part & part, valuation_part const & from, valuation_id v, event_id e, size_type num_events,
+		util::bitset<>::const_span del, util::bitset<>::const_span add, util::bitset<>::common_state cs, workspace::valuation_interning & interning)
+	{
+		size_type & derived = interning.memo[static_cast<std::size_t>(v.id) * num_events + e.id];
+		if (derived == no_valuation)
+		{
+			part.store->sets.push_back(cs).assign_difference_union(cs, get_valuation_sets(from, cs).at(cs, v.id), del, add);
+			valuation_id id = intern_last_valuation(part, cs, interning);
+			record_valuation_delta(part, id, from, v, cs);
+			derived = id.id;
+		}
+		return valuation_id{ derived };
+	}
+
+	void state::intern_valuations(util::bitset<>::common_state proposition_bitset_state, workspace & ws)
+	{
+		intern_valuations(this->V, proposition_bitset_state, ws.base_interning);
+		intern_valuations(this->VA, this->Acs, ws.attention_interning);
+	}
+
+	void state::intern_valuations(valuation_part & part, util::bitset<>::common_state cs, workspace::valuation_interning & interning)
+	{
+		util::bitset_vector<> const set_valuations = std::move(part.store->sets);
+		part.store->sets = util::bitset_vector<>();
+		interning.index.clear();
+
+		for (valuation_id & id : part.ids)
+		{
+			part.store->sets.push_back(cs).copy(cs, set_valuations.at(cs, id.id));
+			id = intern_last_valuation(part, cs, interning);
+		}
+	}
+
+	void state::copy_valuation(world_id w, state const & from, world_id from_w, util::bitset<>::common_state proposition_bitset_state, workspace & ws)
+	{
+		copy_valuation(this->V, w, from.V, from_w, proposition_bitset_state, ws.base_interning.memo);
+		copy_valuation(this->VA, w, from.VA, from_w, this->Acs, ws.attention_interning.memo);
+	}
+
+	void state::copy_valuation(valuation_part & part, world_id w, valuation_part const & from, world_id from_w, util::bitset<>::common_state cs, std::vector<size_type> & memo)
+	{
+		valuation_id v = from.ids[from_w.id];
+		size_type & copied = memo[v.id];
+		if (copied == no_valuation)
+		{
+			valuation_store & store = *part.store;
+			store.sets.push_back(cs).copy(cs, get_valuation(from, from_w, cs));
+			copied = static_cast<size_type>(store.sets.size() - 1);
+
+			// Same base, so the delta carries over as it is.
+			if (store.base)
+			{
+				valuation_store const & from_store = *from.store;
+				std::size_t flips_begin = v.id == 0 ? 0 : from_store.deltas[v.id - 1].second;
+				auto const & [base_valuation, flips_end] = from_store.deltas[v.id];
+				store.flips.insert(store.flips.end(), from_store.flips.begin() + flips_begin, from_store.flips.begin() + flips_end);
+				store.deltas.emplace_back(base_valuation, store.flips.size());
+			}
+		}
+		part.ids[w.id] = valuation_id{ copied };
+	}
+
+	void state::enable_delta_valuations()
+	{
+		this->V.store->delta_encoded_successors = true;
+		this->VA.store->delta_encoded_successors = true;
+	}
+
+	size_type state::get_num_valuations(valuation_part const & part)
+	{
+		valuation_store const & store = *part.store;
+		return static_cast<size_type>(store.released ? store.deltas.size() : store.sets.size());
+	}
+
+	util::bitset_vector<> const & state::get_valuation_sets(valuation_part const & part, util::bitset<>::common_state cs)
+	{
+		if (part.store->released)
+		{
+			materialize(*part.store, cs);
+		}
+		return part.store->sets;
+	}
+
+	util::bitset<>::const_span state::get_valuation(valuation_part const & part, world_id w, util::bitset<>::common_state cs)
+	{
+		return get_valuation_sets(part, cs).at(cs, part.ids[w.id].id);
+	}
+
+	void state::materialize(valuation_store & store, util::bitset<>::common_state cs)
+	{
+		// The base is materialized for the duration if needed, and released again afterwards, so reading an old state doesn't keep its whole chain.
+		valuation_store & base = *store.base;
+		bool base_released = base.released;
+		if (base_released)
+		{
+			materialize(base, cs);
+		}
+
+		store.sets.reserve(cs, store.deltas.size());
+		std::size_t flips_begin = 0;
+		for (auto const & [base_valuation, flips_end] : store.deltas)
+		{
+			auto valuation = store.sets.push_back(cs);
+			valuation.copy(cs, std::as_const(base.sets).at(cs, base_valuation.id));
+			for (std::size_t i = flips_begin; i < flips_end; ++i)
+			{
+				valuation.set(cs, store.flips[i], !valuation.get(cs, store.flips[i]));
+			}
+			flips_begin = flips_end;
+		}
+		store.released = false;
+
+		if (base_released)
+		{
+			release(base);
+		}
+	}
+
+	void state::release(valuation_store & store)
+	{
+		if (!store.base) return;
+
+		store.sets = util::bitset_vector<>();
+		store.released = true;
+	}
+
+	void state::derive_valuations(state const & s)
+	{
+		for (auto [part, s_part] : { std::pair{ &this->V, &s.V }, std::pair{ &this->VA, &s.VA } })
+		{
+			valuation_store const & store = *s_part->store;
+			if (!store.delta_encoded_successors) continue;
+
+			part->store->delta_encoded_successors = true;
+			if (store.depth + 1 < delta_keyframe_interval)
+			{
+				part->store->base = s_part->store;
+				part->store->depth = store.depth + 1;
+			}
+		}
+	}
+
+	void state::share_valuation_base(state const & from)
+	{
+		for (auto [part, from_part] : { std::pair{ &this->V, &from.V }, std::pair{ &this->VA, &from.VA } })
+		{
+			valuation_store const & store = *from_part->store;
+			part->store->delta_encoded_successors = store.delta_encoded_successors;
+			part->store->base = store.base;
+			part->store->depth = store.depth;
+		}
+	}
+
+	void state::record_valuation_delta(valuation_part & part, valuation_id id, valuation_part const & from, valuation_id v, util::bitset<>::common_state cs)
+	{
+		valuation_store & store = *part.store;
+		if (!store.base || id.id < store.deltas.size()) return; // Not delta encoded, or an existing valuation.
+
+		// The flipped bits are those set in exactly one of the two valuations.
+		auto valuation = std::as_const(store.sets).at(cs, id.id);
+		auto original = get_valuation_sets(from, cs).at(cs, v.id);
+		for (auto [a, b] : { std::pair{ valuation, original }, std::pair{ original, valuation } })
+		{
+			for (std::size_t i = a.find_first(cs); i < cs.get_size(); i = a.find_next(cs, i))
+			{
+				if (!b.get(cs, i)) store.flips.push_back(static_cast<size_type>(i));
+			}
+		}
+		store.deltas.emplace_back(v, store.flips.size());
 	}
 
 	bool state::get_accessible(agent_id a, world_id w1, world_id w2) const
 	{
-		return this->R[a.id].get(this->Rcs, w1.id * this->num_worlds + w2.id);
+		return this->R.get(this->Rcs, this->get_row(a, w1), w2.id);
 	}
 
 	void state::set_accessible(agent_id a, world_id w1, world_id w2, bool v)
 	{
-		this->R[a.id].set(this->Rcs, w1.id * this->num_worlds + w2.id, v);
+		this->R.set(this->Rcs, this->get_row(a, w1), w2.id, v);
+	}
+
+	void state::clear_successors(agent_id a, world_id w)
+	{
+		this->R.row_clear(this->Rcs, this->get_row(a, w));
+	}
+
+	state::group_relation & state::get_group_relation(std::vector<size_type> const & group) const
+	{
+		auto it = this->group_relations.find(group);
+		if (it != this->group_relations.end()) return it->second;
+
+		// Successor rows of the joint relation.
+		util::bit_matrix<> successors(this->Gcs);
+		for (size_type w = 0; w < this->num_worlds; ++w)
+		{
+			for (size_type a : group)
+			{
+				successors.row_union(this->Gcs, w, this->R, this->get_row(agent_id{ a }, world_id{ w }));
+			}
+		}
+
+		return this->group_relations.emplace(group, group_relation{ std::move(successors), std::nullopt }).first->second;
+	}
+
+	util::bit_matrix<> const & state::get_joint_successors(std::vector<size_type> const & group) const
+	{
+		return this->get_group_relation(group).successors;
+	}
+
+	util::bit_matrix<> const & state::get_common_belief_closure(std::vector<size_type> const & group) const
+	{
+		group_relation & relation = this->get_group_relation(group);
+		if (relation.closure) return *relation.closure;
+
+		util::bit_matrix<> & closure = relation.closure.emplace(this->Gcs, relation.successors);
+
+		// Warshall's algorithm with whole rows: after step k, w reaches v if it does through intermediate worlds among 0..k.
+		for (size_type k = 0; k < this->num_worlds; ++k)
+		{
+			for (size_type w = 0; w < this->num_worlds; ++w)
+			{
+				if (closure.get(this->Gcs, w, k)) closure.row_union(this->Gcs, w, closure, k);
+			}
+		}
+
+		return closure;
+	}
+
+	bool state::evaluate_cached(formula const & f, world_id w, formula::node_id n, util::bitset<>::common_state proposition_bitset_state, std::size_t capacity, workspace & ws) const
+	{
+		if (!this->formula_results)
+		{
+			this->formula_results = std::make_unique<formula_cache>();
+			this->formula_results->f = &f;
+		}
+		formula_cache & cache = *this->formula_results;
+		// Node ids only mean something within their formula, so results of another one would be answered for the wrong nodes.
+		if (cache.f != &f) throw std::logic_error("formula cache of a state used with another formula");
+		if (capacity == 0) return f.evaluate(*this, w, n, proposition_bitset_state, ws);
+
+		auto it = cache.sets.find(n.id);
+		if (it != cache.sets.end())
+		{
+			++cache.hits;
+			return it->second.get(this->Wcs, w.id);
+		}
+
+		++cache.misses;
+		while (cache.sets.size() >= capacity)
+		{
+			cache.sets.erase(cache.order.front());
+			cache.order.pop_front();
+		}
+		// Subformulas are memoized for this evaluation only, so that they do not take up entries.
+		formula::world_set const & set = cache.sets.emplace(n.id, f.evaluate_all(*this, n, proposition_bitset_state)).first->second;
+		cache.order.push_back(n.id);
+		return set.get(this->Wcs, w.id);
+	}
+
+	std::size_t state::get_formula_cache_hits() const
+	{
+		return this->formula_results ? this->formula_results->hits : 0;
+	}
+
+	std::size_t state::get_formula_cache_misses() const
+	{
+		return this->formula_results ? this->formula_results->misses : 0;
 	}
 
 	size_type state::get_num_worlds() const
@@ -206,5 +942,10 @@ namespace del
 		return this->num_worlds;
 	}
 
+	util::bitset<>::common_state state::get_worlds_bitset_state() const
+	{
+		return this->Wcs;
+	}
+
 	
 }
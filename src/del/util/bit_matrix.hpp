@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "del/util/bitset.hpp"
+#include "del/util/bitset_kernels.hpp"
+
+
+namespace del::util
+{
+	/*
+		Bit matrix with fixed dimensions given at runtime, stored row by row in one allocation.
+		Every row starts at a block boundary, so whole rows can be combined block by block with each other and with bitsets of the column size,
+		and the set bits of a row can be enumerated by counting trailing zeros instead of probing every column.
+		As for bitset, the dimensions are tracked externally in a common_state passed into the member functions.
+	*/
+	template<typename block_type = std::size_t>
+	class bit_matrix
+	{
+	public:
+		static_assert(std::is_unsigned<block_type>::value);
+
+		class common_state
+		{
+			friend class bit_matrix<block_type>;
+
+			static constexpr std::size_t block_size_bits = sizeof(block_type) * 8;
+
+			std::size_t const num_rows;
+			std::size_t const num_cols;
+			std::size_t const row_blocks;
+
+		public:
+			common_state(std::size_t num_rows, std::size_t num_cols) :
+				num_rows(num_rows),
+				num_cols(num_cols),
+				row_blocks(num_cols / block_size_bits + (num_cols % block_size_bits ? 1 : 0))
+			{
+			}
+
+			std::size_t get_num_rows() const
+			{
+				return this->num_rows;
+			}
+		};
+
+		// Blocks of memory needed for a matrix of the given dimensions.
+		static std::size_t get_num_blocks(common_state const & cs)
+		{
+			return cs.num_rows * cs.row_blocks;
+		}
+
+		explicit bit_matrix(common_state const & cs) :
+			owned(std::make_unique<block_type[]>(get_num_blocks(cs))),
+			blocks(owned.get())
+		{
+			/* Blocks are zero-initialized; the excess bits at the end of every row are kept 0 by all operations. */
+		}
+
+		// Uses get_num_blocks(cs) blocks of memory owned elsewhere, which must outlive the matrix; the contents are left as they are.
+		explicit bit_matrix(block_type * memory) :
+			owned(),
+			blocks(memory)
+		{
+		}
+
+		bit_matrix(bit_matrix const &) = delete;
+		bit_matrix & operator=(bit_matrix const &) = delete;
+
+		/*
+			In place of copy constructor.
+		*/
+		bit_matrix(common_state const & cs, bit_matrix const & m) :
+			owned(std::make_unique<block_type[]>(get_num_blocks(cs))),
+			blocks(owned.get())
+		{
+			std::memcpy(this->blocks, m.blocks, get_num_blocks(cs) * sizeof(block_type));
+		}
+
+		bit_matrix(bit_matrix && m) noexcept = default;
+		bit_matrix & operator=(bit_matrix && m) noexcept = default;
+
+		~bit_matrix() = default;
+
+		bool get(common_state const & cs, std::size_t r, std::size_t c) const
+		{
+			return (this->row(cs, r)[c / cs.block_size_bits] >> (c % cs.block_size_bits)) & static_cast<block_type>(1);
+		}
+
+		bit_matrix & set(common_state const & cs, std::size_t r, std::size_t c, bool value)
+		{
+			block_type & block = this->row(cs, r)[c / cs.block_size_bits];
+			block_type mask = static_cast<block_type>(1) << (c % cs.block_size_bits);
+			if (value) block |= mask;
+			else block &= ~mask;
+			return *this;
+		}
+
+		// Clears row r, including its excess bits; the row may be uninitialized before.
+		bit_matrix & row_clear(common_state const & cs, std::size_t r)
+		{
+			std::fill_n(this->row(cs, r), cs.row_blocks, static_cast<block_type>(0));
+			return *this;
+		}
+
+		/*
+			Calls f(c) for every set column c of row r in increasing order, as long as f returns true.
+			Returns whether all set columns were visited.
+		*/
+		template<typename F>
+		bool for_each_in_row(common_state const & cs, std::size_t r, F && f) const
+		{
+			block_type const * row = this->row(cs, r);
+			for (std::size_t i = 0; i < cs.row_blocks; ++i)
+			{
+				for (block_type block = row[i]; block != 0; block &= block - 1)
+				{
+					if (!f(i * cs.block_size_bits + count_trailing_zeros(block))) return false;
+				}
+			}
+			return true;
+		}
+
+		// Row r |= row r2 of m.
+		bit_matrix & row_union(common_state const & cs, std::size_t r, bit_matrix const & m, std::size_t r2)
+		{
+			block_type * row = this->row(cs, r);
+			block_type const * other = m.row(cs, r2);
+			if (use_kernels(cs)) kernels::get().inplace_union(row, other, cs.row_blocks);
+			else for (std::size_t i = 0; i < cs.row_blocks; ++i) row[i] |= other[i];
+			return *this;
+		}
+
+		// Row r &= row r2 of m.
+		bit_matrix & row_intersection(common_state const & cs, std::size_t r, bit_matrix const & m, std::size_t r2)
+		{
+			block_type * row = this->row(cs, r);
+			block_type const * other = m.row(cs, r2);
+			if (use_kernels(cs)) kernels::get().inplace_intersection(row, other, cs.row_blocks);
+			else for (std::size_t i = 0; i < cs.row_blocks; ++i) row[i] &= other[i];
+			return *this;
+		}
+
+		// Row r, seen as a set of columns, is a subset of b; b must have as many bits as there are columns.
+		bool row_is_subset_of(common_state const & cs, std::size_t r, bitset_span<block_type const> b) const
+		{
+			block_type const * row = this->row(cs, r);
+			if (use_kernels(cs)) return kernels::get().is_subset_of(row, b.blocks, cs.row_blocks);
+			for (std::size_t i = 0; i < cs.row_blocks; ++i)
+			{
+				if (row[i] & ~b.blocks[i]) return false;
+			}
+			return true;
+		}
+
+		// Row r, seen as a set of columns, intersects b; b must have as many bits as there are columns.
+		bool row_intersects(common_state const & cs, std::size_t r, bitset_span<block_type const> b) const
+		{
+			block_type const * row = this->row(cs, r);
+			if (use_kernels(cs)) return kernels::get().intersects(row, b.blocks, cs.row_blocks);
+			for (std::size_t i = 0; i < cs.row_blocks; ++i)
+			{
+				if (row[i] & b.blocks[i]) return true;
+			}
+			return false;
+		}
+
+		// b = row r; b must have as many bits as there are columns.
+		void row_copy_into(common_state const & cs, std::size_t r, bitset_span<block_type> b) const
+		{
+			std::memcpy(b.blocks, this->row(cs, r), cs.row_blocks * sizeof(block_type));
+		}
+
+		// b &= row r; b must have as many bits as there are columns.
+		void row_intersection_into(common_state const & cs, std::size_t r, bitset_span<block_type> b) const
+		{
+			block_type const * row = this->row(cs, r);
+			if (use_kernels(cs)) kernels::get().inplace_intersection(b.blocks, row, cs.row_blocks);
+			else for (std::size_t i = 0; i < cs.row_blocks; ++i) b.blocks[i] &= row[i];
+		}
+
+		// b |= row r; b must have as many bits as there are columns.
+		void row_union_into(common_state const & cs, std::size_t r, bitset_span<block_type> b) const
+		{
+			block_type const * row = this->row(cs, r);
+			if (use_kernels(cs)) kernels::get().inplace_union(b.blocks, row, cs.row_blocks);
+			else for (std::size_t i = 0; i < cs.row_blocks; ++i) b.blocks[i] |= row[i];
+		}
+
+	private:
+		std::unique_ptr<block_type[]> owned; // Empty if the memory is owned elsewhere.
+		block_type * blocks;
+
+		// As for bitset, long rows of the default block type go through the vectorized kernels.
+		static bool use_kernels([[maybe_unused]] common_state const & cs)
+		{
+			if constexpr (std::is_same<block_type, std::size_t>::value) return cs.row_blocks >= kernels::min_blocks;
+			else return false;
+		}
+
+		block_type * row(common_state const & cs, std::size_t r)
+		{
+			return this->blocks + r * cs.row_blocks;
+		}
+
+		block_type const * row(common_state const & cs, std::size_t r) const
+		{
+			return this->blocks + r * cs.row_blocks;
+		}
+	};
+}
@@ -1,120 +1,180 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <memory>
 #include <type_traits>
 
+#include "del/util/bitset_kernels.hpp"
+#include "del/util/hash.hpp"
+
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 
 namespace del::util
 {
 	/*
-		Bitset with fixed size given at runtime.
-		We want to efficiently support creating very many bitsets of the same sizes, so we don't store common state in each instance.
-		The code which uses this class is responsible for tracking the necessary common state externally and passing it into the member functions accordingly.
+		Index of the lowest set bit; block must be non-zero.
 	*/
-	template<typename block_type = std::size_t> 
-	class bitset
+	template<typename block_type>
+	inline std::size_t count_trailing_zeros(block_type block)
 	{
-	public:
-		static_assert(std::is_unsigned<block_type>::value);
-		static_assert(std::is_trivially_copyable<block_type[]>::value);
+		static_assert(std::is_unsigned<block_type>::value && sizeof(block_type) <= 8);
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward64(&idx, static_cast<unsigned __int64>(block));
+		return idx;
+#elif defined(__GNUG__) || defined(__clang__)
+		return static_cast<std::size_t>(__builtin_ctzll(static_cast<unsigned long long>(block)));
+#else
+		std::size_t idx = 0;
+		while (!((block >> idx) & 1)) ++idx;
+		return idx;
+#endif
+	}
 
-		/*
-			Provides the shared state.
-			Should be small enough to pass by value, ensuring local copies in functions which eases vectorization by the compiler.
-		*/
-		class common_state
-		{
-			friend class bitset<block_type>;
+	template<typename block_type>
+	class bit_matrix;
 
-			static constexpr std::size_t block_size_bytes = sizeof(block_type);
-			static constexpr std::size_t block_size_bits = block_size_bytes * 8;
+	template<typename block_type = std::size_t, std::size_t inline_blocks = 0>
+	class bitset;
 
-			std::size_t const size;
-			std::size_t const num_blocks;
-			block_type const excess_mask;
+	template<typename block_type>
+	class bitset_span;
 
-			std::pair<std::size_t, std::size_t> get_value_idx(std::size_t i) const
-			{
+	template<typename block_type>
+	class bitset_array;
+
+	template<typename block_type>
+	class bitset_vector;
+
+	/*
+		Provides the shared state of bitsets with the same size and block type.
+		Should be small enough to pass by value, ensuring local copies in functions which eases vectorization by the compiler.
+		Shared by all inline sizes, so e.g. bitset<>::common_state also serves bitsets with inline storage.
+	*/
+	template<typename block_type>
+	class bitset_common_state
+	{
+		template<typename, std::size_t>
+		friend class bitset;
+		template<typename>
+		friend class bitset_span;
+		template<typename>
+		friend class bitset_array;
+		template<typename>
+		friend class bitset_vector;
+
+		static constexpr std::size_t block_size_bytes = sizeof(block_type);
+		static constexpr std::size_t block_size_bits = block_size_bytes * 8;
+
+		std::size_t const size;
+		std::size_t const num_blocks;
+		block_type const excess_mask;
+
+		std::pair<std::size_t, std::size_t> get_value_idx(std::size_t i) const
+		{
 #if _DEBUG
-				if (i >= this->size) throw std::runtime_error("Index out of bounds");
+			if (i >= this->size) throw std::runtime_error("Index out of bounds");
 #endif
-				return { i / block_size_bits, i - (i / block_size_bits) * this->num_blocks };
-			}
+			return { i / block_size_bits, i % block_size_bits };
+		}
 
-		public:
-			explicit common_state(std::size_t size) :
-				size(size),
-				num_blocks(size / block_size_bits + (size % block_size_bits ? 1 : 0)),
-				excess_mask(((size % block_size_bits) ? ((block_type)1 << (size % block_size_bits)) : (block_type)0) - 1)
-			{
-			}
-		};
+	public:
+		explicit bitset_common_state(std::size_t size) :
+			size(size),
+			num_blocks(size / block_size_bits + (size % block_size_bits ? 1 : 0)),
+			excess_mask(((size % block_size_bits) ? ((block_type)1 << (size % block_size_bits)) : (block_type)0) - 1)
+		{
+		}
 
-		explicit bitset(common_state const & cs) :
-			blocks(std::make_unique<block_type[]>(cs.num_blocks))
+		std::size_t get_size() const
 		{
-			/*
-				We assume all operations on bitsets are only performed of bitsets of same size.
-				Blocks are zero-initialized.
-				We will set and preserve the excess bits in the last block to be 0.
-				This invariant is used and maintained by all operations.
-			*/
+			return this->size;
 		}
 
-		/*
-			Bitsets won't be copyable in the usual way, since they don't contain enough state to take a deep copy.
-		*/
-		bitset(bitset const &) = delete;
-		bitset & operator=(bitset const &) = delete;
+		// Bits taken by one bitset including the excess bits of its last block, i.e. the stride of bitsets stored back to back.
+		std::size_t get_aligned_size() const
+		{
+			return this->num_blocks * block_size_bits;
+		}
 
-		/*
-			In place of copy constructor.
-		*/
-		bitset(common_state const & cs, bitset const & b) :
-			blocks(std::make_unique<block_type[]>(cs.num_blocks))
+		// Common state of num_rows bitsets of this state stored back to back as one bitset, e.g. a matrix with block aligned rows; row r starts at bit r * get_aligned_size().
+		bitset_common_state get_rows_state(std::size_t num_rows) const
 		{
-			/* Make sure memcpy copies all blocks entirely (including the excess bits, so they're zeroed). */
-			std::memcpy(this->blocks.get(), b.blocks.get(), cs.num_blocks * cs.block_size_bytes);
+			return bitset_common_state(num_rows * this->get_aligned_size());
 		}
+	};
 
-		/*
-			In place of copy assignment.
-		*/
-		bitset & copy(common_state const & cs, bitset const & b)
+	/*
+		The blocks of one bitset whose memory is owned elsewhere: by a bitset, or as one element of a bitset_array or bitset_vector.
+		Holds the set algebra for both; a bitset converts implicitly to a span of its blocks, so spans and bitsets can be combined freely.
+		Instantiated with a const block type for read-only access.
+	*/
+	template<typename block_type>
+	class bitset_span
+	{
+	public:
+		using value_type = std::remove_const_t<block_type>;
+		using common_state = bitset_common_state<value_type>;
+		using const_span = bitset_span<value_type const>;
+
+		static_assert(std::is_unsigned<value_type>::value);
+
+		explicit bitset_span(block_type * blocks) :
+			blocks(blocks)
 		{
-			/* Excess bits must already be zeroed; so we could have omitted to copy these. */
-			std::memcpy(this->blocks.get(), b.blocks.get(), cs.num_blocks * cs.block_size_bytes);
-			return *this;
 		}
 
-		bitset(bitset && b) noexcept :
-			blocks(std::move(b.blocks))
+		// Read-only view of a mutable span.
+		template<typename other_block_type, typename = std::enable_if_t<std::is_same<other_block_type const, block_type>::value>>
+		bitset_span(bitset_span<other_block_type> s) :
+			blocks(s.blocks)
 		{
-			/* Excess bits inherently zeroed. */
 		}
 
-		bitset & operator=(bitset && b) noexcept
+		/*
+			Copy assignment of the bits, where the span itself is copied as a handle.
+		*/
+		bitset_span & copy(common_state const & cs, const_span b)
 		{
-			/* Excess bits inherently zeroed. */
-			this->blocks = std::move(b.blocks);
+			/* Excess bits must already be zeroed; so we could have omitted to copy these. */
+			std::memcpy(this->blocks, b.blocks, cs.num_blocks * cs.block_size_bytes);
 			return *this;
 		}
 
-		~bitset() = default;
+		/*
+			Assigns (b & ~del) | add in one pass, e.g. a valuation after the post conditions of an event.
+			Unlike the in-place operations, this doesn't read the previous contents, so it may be used on uninitialized memory.
+		*/
+		bitset_span & assign_difference_union(common_state const & cs, const_span b, const_span del, const_span add)
+		{
+			for (size_t i = 0; i < cs.num_blocks; ++i)
+			{
+				this->blocks[i] = (b.blocks[i] & ~del.blocks[i]) | add.blocks[i];
+			}
+			return *this;
+		}
 
-		bitset & set(common_state const & cs, std::size_t i, bool value)
+		bitset_span & set(common_state const & cs, std::size_t i, bool value)
 		{
 			auto[block_idx, bit_idx] = cs.get_value_idx(i); //Getting Block and Bit Index
-			if (value) this->blocks[block_idx] |= (static_cast<block_type>(1) <<  bit_idx); //sets the bit at position bit_idx within the block at block_idx to 1.
-			else this->blocks[block_idx] &= ~(static_cast<block_type>(1) << bit_idx); //clears the bit at position bit_idx within the block at block_idx, setting it to 0.
+			if (value) this->blocks[block_idx] |= (static_cast<value_type>(1) <<  bit_idx); //sets the bit at position bit_idx within the block at block_idx to 1.
+			else this->blocks[block_idx] &= ~(static_cast<value_type>(1) << bit_idx); //clears the bit at position bit_idx within the block at block_idx, setting it to 0.
 			return *this;
 		}
 
-		bitset & inplace_intersection(common_state const & cs, bitset const & b)
+		bitset_span & inplace_intersection(common_state const & cs, const_span b)
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs))
+			{
+				kernels::get().inplace_intersection(this->blocks, b.blocks, cs.num_blocks);
+				return *this;
+			}
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				this->blocks[i] &= b.blocks[i];
@@ -122,9 +182,13 @@ namespace del::util
 			return *this;
 		}
 
-		bitset & inplace_union(common_state const & cs, bitset const & b)
+		bitset_span & inplace_union(common_state const & cs, const_span b)
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs))
+			{
+				kernels::get().inplace_union(this->blocks, b.blocks, cs.num_blocks);
+				return *this;
+			}
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				this->blocks[i] |= b.blocks[i];
@@ -132,7 +196,7 @@ namespace del::util
 			return *this;
 		}
 
-		bitset & inplace_symmetric_difference(common_state const & cs, bitset const & b)
+		bitset_span & inplace_symmetric_difference(common_state const & cs, const_span b)
 		{
 			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
 			for (size_t i = 0; i < cs.num_blocks; ++i)
@@ -142,9 +206,13 @@ namespace del::util
 			return *this;
 		}
 
-		bitset & inplace_difference(common_state const & cs, bitset const & b)
+		bitset_span & inplace_difference(common_state const & cs, const_span b)
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs))
+			{
+				kernels::get().inplace_difference(this->blocks, b.blocks, cs.num_blocks);
+				return *this;
+			}
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				this->blocks[i] &= ~b.blocks[i];
@@ -152,7 +220,7 @@ namespace del::util
 			return *this;
 		}
 
-		bitset & flip(common_state const & cs)
+		bitset_span & flip(common_state const & cs)
 		{
 			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
 			for (size_t i = 0; i < cs.num_blocks; ++i)
@@ -163,7 +231,7 @@ namespace del::util
 			return *this;
 		}
 
-		bitset & clear(common_state const & cs)
+		bitset_span & clear(common_state const & cs)
 		{
 			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
 			for (size_t i = 0; i < cs.num_blocks; ++i)
@@ -176,12 +244,12 @@ namespace del::util
 		bool get(common_state const & cs, std::size_t i) const
 		{
 			auto[block_idx, bit_idx] = cs.get_value_idx(i);
-			return (this->blocks[block_idx] >> bit_idx) & static_cast<block_type>(1);
+			return (this->blocks[block_idx] >> bit_idx) & static_cast<value_type>(1);
 		}
 
-		bool is_subset_of(common_state const & cs, bitset const & b) const
+		bool is_subset_of(common_state const & cs, const_span b) const
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs)) return kernels::get().is_subset_of(this->blocks, b.blocks, cs.num_blocks);
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				if ((this->blocks[i] | b.blocks[i]) != b.blocks[i]) return false;
@@ -189,9 +257,9 @@ namespace del::util
 			return true;
 		}
 
-		bool intersects(common_state const & cs, bitset const & b) const
+		bool intersects(common_state const & cs, const_span b) const
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs)) return kernels::get().intersects(this->blocks, b.blocks, cs.num_blocks);
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				if (this->blocks[i] & b.blocks[i]) return true;
@@ -201,7 +269,7 @@ namespace del::util
 
 		bool none(common_state const & cs) const
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs)) return kernels::get().none(this->blocks, cs.num_blocks);
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				if (this->blocks[i]) return false;
@@ -209,9 +277,9 @@ namespace del::util
 			return true;
 		}
 
-		bool equals(common_state const & cs, bitset const & b) const
+		bool equals(common_state const & cs, const_span b) const
 		{
-			// TODO: Verify that this can be auto-vectorized. Const common_state might not be enough? Might have to take local copy of num_blocks?
+			if (use_kernels(cs)) return kernels::get().equals(this->blocks, b.blocks, cs.num_blocks);
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
 				if (this->blocks[i] != b.blocks[i]) return false;
@@ -219,29 +287,328 @@ namespace del::util
 			return true;
 		}
 
-		bool not_equals(common_state const & cs, bitset const & b) const
+		bool not_equals(common_state const & cs, const_span b) const
 		{
 			return !this->equals(cs, b);
 		}
 
+		// Number of set bits.
+		std::size_t count(common_state const & cs) const
+		{
+			if (use_kernels(cs)) return kernels::get().count(this->blocks, cs.num_blocks);
+			std::size_t result = 0;
+			for (size_t i = 0; i < cs.num_blocks; ++i)
+			{
+				for (value_type block = this->blocks[i]; block != 0; block &= block - 1) ++result;
+			}
+			return result;
+		}
+
+		// Index of the lowest set bit, or the size of the bitset if none is set.
+		std::size_t find_first(common_state const & cs) const
+		{
+			if (cs.num_blocks == 0) return cs.size;
+			return this->find_from_block(cs, 0, ~static_cast<value_type>(0));
+		}
+
+		// Index of the lowest set bit above i, or the size of the bitset if there is none.
+		std::size_t find_next(common_state const & cs, std::size_t i) const
+		{
+			if (++i >= cs.size) return cs.size;
+			auto[block_idx, bit_idx] = cs.get_value_idx(i);
+			return this->find_from_block(cs, block_idx, ~static_cast<value_type>(0) << bit_idx);
+		}
+
 		// Only for diagnostics.
-		block_type get_first_block() const
+		value_type get_first_block() const
 		{
 			return this->blocks[0];
 		}
 
-		// Only for diagnostics.
+		// Used for bucketing valuations in bisimulation contraction; equal bitsets hash equal.
 		std::size_t get_hash(common_state const & cs) const {
 			size_t h = 0;
 			for (size_t i = 0; i < cs.num_blocks; ++i)
 			{
-				// From boost::hash_combine:
-				h ^= this->blocks[i] + 0x9e3779b9 + (h << 6) + (h >> 2);
+				hash_combine(h, this->blocks[i]);
 			}
 			return h;
 		}
 
 	private:
-		std::unique_ptr<block_type[]> blocks;
+		template<typename>
+		friend class bitset_span;
+		template<typename, std::size_t>
+		friend class bitset;
+		friend class bit_matrix<value_type>; // For combining matrix rows with bitsets.
+
+		block_type * blocks;
+
+		/*
+			Bitsets of the default block type and at least kernels::min_blocks blocks use the vectorized kernels; smaller ones stay with the inline loops.
+		*/
+		static bool use_kernels([[maybe_unused]] common_state const & cs)
+		{
+			if constexpr (std::is_same<value_type, std::size_t>::value) return cs.num_blocks >= kernels::min_blocks;
+			else return false;
+		}
+
+		// Lowest set bit in the blocks from block_idx on, with the first block masked.
+		std::size_t find_from_block(common_state const & cs, std::size_t block_idx, value_type first_mask) const
+		{
+			value_type block = this->blocks[block_idx] & first_mask;
+			if (!block)
+			{
+				if (use_kernels(cs)) block_idx = kernels::get().find_nonzero(this->blocks, block_idx + 1, cs.num_blocks);
+				else
+				{
+					do ++block_idx; while (block_idx < cs.num_blocks && !this->blocks[block_idx]);
+				}
+				if (block_idx >= cs.num_blocks) return cs.size;
+				block = this->blocks[block_idx];
+			}
+			return block_idx * cs.block_size_bits + count_trailing_zeros(block);
+		}
+	};
+
+	namespace detail
+	{
+		// Blocks kept within a bitset object; empty for inline_blocks == 0 so such bitsets stay the size of a pointer.
+		template<typename block_type, std::size_t inline_blocks>
+		struct bitset_inline_storage
+		{
+			block_type local[inline_blocks];
+
+			block_type * get_local() { return this->local; }
+			block_type const * get_local() const { return this->local; }
+		};
+
+		template<typename block_type>
+		struct bitset_inline_storage<block_type, 0>
+		{
+			block_type * get_local() { return nullptr; }
+			block_type const * get_local() const { return nullptr; }
+		};
+	}
+
+	/*
+		Bitset with fixed size given at runtime.
+		We want to efficiently support creating very many bitsets of the same sizes, so we don't store common state in each instance.
+		The code which uses this class is responsible for tracking the necessary common state externally and passing it into the member functions accordingly.
+		Bitsets of at most inline_blocks blocks keep them within the object instead of allocating; larger ones spill to the heap.
+		The set algebra is that of bitset_span, applied to the bitset's own blocks.
+	*/
+	template<typename block_type, std::size_t inline_blocks>
+	class bitset : private detail::bitset_inline_storage<block_type, inline_blocks>
+	{
+	public:
+		static_assert(std::is_unsigned<block_type>::value);
+		static_assert(std::is_trivially_copyable<block_type[]>::value);
+
+		using common_state = bitset_common_state<block_type>;
+		using span = bitset_span<block_type>;
+		using const_span = bitset_span<block_type const>;
+
+		explicit bitset(common_state const & cs) :
+			blocks(this->allocate(cs))
+		{
+			/*
+				We assume all operations on bitsets are only performed of bitsets of same size.
+				Blocks are zero-initialized.
+				We will set and preserve the excess bits in the last block to be 0.
+				This invariant is used and maintained by all operations.
+			*/
+		}
+
+		/*
+			Bitsets won't be copyable in the usual way, since they don't contain enough state to take a deep copy.
+		*/
+		bitset(bitset const &) = delete;
+		bitset & operator=(bitset const &) = delete;
+
+		/*
+			In place of copy constructor.
+		*/
+		bitset(common_state const & cs, const_span b) :
+			blocks(this->allocate(cs))
+		{
+			/* Make sure memcpy copies all blocks entirely (including the excess bits, so they're zeroed). */
+			std::memcpy(this->blocks, b.blocks, cs.num_blocks * cs.block_size_bytes);
+		}
+
+		bitset(bitset && b) noexcept :
+			blocks(nullptr)
+		{
+			/* Excess bits inherently zeroed. */
+			this->take(b);
+		}
+
+		bitset & operator=(bitset && b) noexcept
+		{
+			/* Excess bits inherently zeroed. */
+			if (this != &b)
+			{
+				this->release();
+				this->take(b);
+			}
+			return *this;
+		}
+
+		~bitset()
+		{
+			this->release();
+		}
+
+		operator span()
+		{
+			return span(this->blocks);
+		}
+
+		operator const_span() const
+		{
+			return const_span(this->blocks);
+		}
+
+		/*
+			In place of copy assignment.
+		*/
+		bitset & copy(common_state const & cs, const_span b)
+		{
+			span(*this).copy(cs, b);
+			return *this;
+		}
+
+		bitset & set(common_state const & cs, std::size_t i, bool value)
+		{
+			span(*this).set(cs, i, value);
+			return *this;
+		}
+
+		bitset & inplace_intersection(common_state const & cs, const_span b)
+		{
+			span(*this).inplace_intersection(cs, b);
+			return *this;
+		}
+
+		bitset & inplace_union(common_state const & cs, const_span b)
+		{
+			span(*this).inplace_union(cs, b);
+			return *this;
+		}
+
+		bitset & inplace_symmetric_difference(common_state const & cs, const_span b)
+		{
+			span(*this).inplace_symmetric_difference(cs, b);
+			return *this;
+		}
+
+		bitset & inplace_difference(common_state const & cs, const_span b)
+		{
+			span(*this).inplace_difference(cs, b);
+			return *this;
+		}
+
+		bitset & flip(common_state const & cs)
+		{
+			span(*this).flip(cs);
+			return *this;
+		}
+
+		bitset & clear(common_state const & cs)
+		{
+			span(*this).clear(cs);
+			return *this;
+		}
+
+		bool get(common_state const & cs, std::size_t i) const
+		{
+			return const_span(*this).get(cs, i);
+		}
+
+		bool is_subset_of(common_state const & cs, const_span b) const
+		{
+			return const_span(*this).is_subset_of(cs, b);
+		}
+
+		bool intersects(common_state const & cs, const_span b) const
+		{
+			return const_span(*this).intersects(cs, b);
+		}
+
+		bool none(common_state const & cs) const
+		{
+			return const_span(*this).none(cs);
+		}
+
+		bool equals(common_state const & cs, const_span b) const
+		{
+			return const_span(*this).equals(cs, b);
+		}
+
+		bool not_equals(common_state const & cs, const_span b) const
+		{
+			return const_span(*this).not_equals(cs, b);
+		}
+
+		std::size_t count(common_state const & cs) const
+		{
+			return const_span(*this).count(cs);
+		}
+
+		std::size_t find_first(common_state const & cs) const
+		{
+			return const_span(*this).find_first(cs);
+		}
+
+		std::size_t find_next(common_state const & cs, std::size_t i) const
+		{
+			return const_span(*this).find_next(cs, i);
+		}
+
+		// Only for diagnostics.
+		block_type get_first_block() const
+		{
+			return this->blocks[0];
+		}
+
+		std::size_t get_hash(common_state const & cs) const
+		{
+			return const_span(*this).get_hash(cs);
+		}
+
+	private:
+		block_type * blocks; // Either the inline storage or owned heap memory.
+
+		block_type * allocate(common_state const & cs)
+		{
+			if (cs.num_blocks <= inline_blocks)
+			{
+				// Blocks beyond the size are never read, but zero them all anyway so moves copy defined values.
+				std::fill_n(this->get_local(), inline_blocks, static_cast<block_type>(0));
+				return this->get_local();
+			}
+			return new block_type[cs.num_blocks]();
+		}
+
+		void release()
+		{
+			if (this->blocks != this->get_local()) delete[] this->blocks;
+			this->blocks = nullptr;
+		}
+
+		// Takes the blocks of b, leaving b without any; inline blocks are copied, since they can't be handed over.
+		void take(bitset & b)
+		{
+			if (b.blocks != nullptr && b.blocks == b.get_local())
+			{
+				std::copy_n(b.get_local(), inline_blocks, this->get_local());
+				this->blocks = this->get_local();
+			}
+			else
+			{
+				this->blocks = b.blocks;
+			}
+			b.blocks = nullptr;
+		}
 	};
 }
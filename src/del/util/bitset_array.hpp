@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "del/util/bitset.hpp"
+
+
+namespace del::util
+{
+	/*
+		Fixed number of bitsets of the same size, stored back to back in one block of memory and addressed by index.
+		Elements are accessed as bitset_span, so they have the same set algebra as bitset; the size is tracked externally in a common_state as for bitset.
+		The memory is either allocated by the array, or handed to it by the owner of a larger allocation holding several arrays (see get_num_blocks).
+	*/
+	template<typename block_type = std::size_t>
+	class bitset_array
+	{
+	public:
+		using common_state = bitset_common_state<block_type>;
+		using span = bitset_span<block_type>;
+		using const_span = bitset_span<block_type const>;
+
+		// Blocks of memory needed for count bitsets.
+		static std::size_t get_num_blocks(common_state const & cs, std::size_t count)
+		{
+			return count * cs.num_blocks;
+		}
+
+		// Allocates and zeroes the memory for count bitsets.
+		bitset_array(common_state const & cs, std::size_t count) :
+			owned(std::make_unique<block_type[]>(get_num_blocks(cs, count))),
+			blocks(owned.get())
+		{
+		}
+
+		// Uses get_num_blocks(cs, count) blocks of memory owned elsewhere, which must outlive the array; the contents are left as they are.
+		explicit bitset_array(block_type * memory) :
+			owned(),
+			blocks(memory)
+		{
+		}
+
+		bitset_array(bitset_array const &) = delete;
+		bitset_array & operator=(bitset_array const &) = delete;
+		bitset_array(bitset_array &&) noexcept = default;
+		bitset_array & operator=(bitset_array &&) noexcept = default;
+
+		~bitset_array() = default;
+
+		span at(common_state const & cs, std::size_t i)
+		{
+			return span(this->blocks + i * cs.num_blocks);
+		}
+
+		const_span at(common_state const & cs, std::size_t i) const
+		{
+			return const_span(this->blocks + i * cs.num_blocks);
+		}
+
+	private:
+		std::unique_ptr<block_type[]> owned; // Empty if the memory is owned elsewhere.
+		block_type * blocks;
+	};
+}
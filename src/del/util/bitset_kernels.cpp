@@ -0,0 +1,556 @@
+#include "del/util/bitset_kernels.hpp"
+
+#include <bitset>
+#include <climits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DEL_KERNELS_X86_64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/*
+	GCC and Clang only emit instructions of an extension inside functions compiled for it, so the wider kernels are tagged with a target attribute.
+	MSVC emits any intrinsic regardless; runtime dispatch alone keeps them from executing on CPUs without support.
+*/
+#if defined(__GNUG__) || defined(__clang__)
+#define DEL_TARGET(features) __attribute__((target(features)))
+#else
+#define DEL_TARGET(features)
+#endif
+
+
+namespace del::util::kernels
+{
+	namespace
+	{
+		using block = std::size_t;
+
+		/* Scalar, always available. */
+
+		void scalar_inplace_union(block * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i) a[i] |= b[i];
+		}
+
+		void scalar_inplace_intersection(block * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i) a[i] &= b[i];
+		}
+
+		void scalar_inplace_difference(block * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i) a[i] &= ~b[i];
+		}
+
+		bool scalar_is_subset_of(block const * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (a[i] & ~b[i]) return false;
+			}
+			return true;
+		}
+
+		bool scalar_intersects(block const * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (a[i] & b[i]) return true;
+			}
+			return false;
+		}
+
+		bool scalar_equals(block const * a, block const * b, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (a[i] != b[i]) return false;
+			}
+			return true;
+		}
+
+		bool scalar_none(block const * a, std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (a[i]) return false;
+			}
+			return true;
+		}
+
+		std::size_t scalar_count(block const * a, std::size_t n)
+		{
+			std::size_t result = 0;
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				result += std::bitset<sizeof(block) * CHAR_BIT>(a[i]).count();
+			}
+			return result;
+		}
+
+		std::size_t scalar_find_nonzero(block const * a, std::size_t from, std::size_t n)
+		{
+			while (from < n && !a[from]) ++from;
+			return from;
+		}
+
+		constexpr table scalar_table{
+			scalar_inplace_union, scalar_inplace_intersection, scalar_inplace_difference,
+			scalar_is_subset_of, scalar_intersects, scalar_equals, scalar_none,
+			scalar_count, scalar_find_nonzero,
+			"scalar"
+		};
+
+#if DEL_KERNELS_X86_64
+		/*
+			Vector kernels handle as many whole vectors as fit and leave the remaining blocks to the scalar kernels.
+			Loads and stores are unaligned, since bitset blocks are only aligned to the block size.
+		*/
+
+		/* SSE2, part of the x86-64 baseline. */
+
+		constexpr std::size_t sse2_blocks = sizeof(__m128i) / sizeof(block);
+
+		void sse2_inplace_union(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), _mm_or_si128(x, y));
+			}
+			scalar_inplace_union(a + i, b + i, n - i);
+		}
+
+		void sse2_inplace_intersection(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), _mm_and_si128(x, y));
+			}
+			scalar_inplace_intersection(a + i, b + i, n - i);
+		}
+
+		void sse2_inplace_difference(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), _mm_andnot_si128(y, x));
+			}
+			scalar_inplace_difference(a + i, b + i, n - i);
+		}
+
+		// SSE2 has no test instruction; compare all bytes against zero instead.
+		bool sse2_is_zero(__m128i x)
+		{
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) == 0xFFFF;
+		}
+
+		bool sse2_is_subset_of(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				if (!sse2_is_zero(_mm_andnot_si128(y, x))) return false;
+			}
+			return scalar_is_subset_of(a + i, b + i, n - i);
+		}
+
+		bool sse2_intersects(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				if (!sse2_is_zero(_mm_and_si128(x, y))) return true;
+			}
+			return scalar_intersects(a + i, b + i, n - i);
+		}
+
+		bool sse2_equals(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+				__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) return false;
+			}
+			return scalar_equals(a + i, b + i, n - i);
+		}
+
+		bool sse2_none(block const * a, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				if (!sse2_is_zero(_mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i)))) return false;
+			}
+			return scalar_none(a + i, n - i);
+		}
+
+		std::size_t sse2_find_nonzero(block const * a, std::size_t from, std::size_t n)
+		{
+			std::size_t i = from;
+			for (; i + sse2_blocks <= n; i += sse2_blocks)
+			{
+				if (!sse2_is_zero(_mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i)))) break;
+			}
+			return scalar_find_nonzero(a, i, n);
+		}
+
+		/* POPCNT, paired with SSE2 and AVX2 for count. */
+
+		DEL_TARGET("popcnt")
+		std::size_t popcnt_count(block const * a, std::size_t n)
+		{
+			std::size_t result = 0;
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				result += static_cast<std::size_t>(_mm_popcnt_u64(a[i]));
+			}
+			return result;
+		}
+
+		/* AVX2; the 256-bit test instructions come with AVX. */
+
+		constexpr std::size_t avx2_blocks = sizeof(__m256i) / sizeof(block);
+
+		DEL_TARGET("avx2")
+		void avx2_inplace_union(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_or_si256(x, y));
+			}
+			scalar_inplace_union(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		void avx2_inplace_intersection(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_and_si256(x, y));
+			}
+			scalar_inplace_intersection(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		void avx2_inplace_difference(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), _mm256_andnot_si256(y, x));
+			}
+			scalar_inplace_difference(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		bool avx2_is_subset_of(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				if (!_mm256_testc_si256(y, x)) return false; // testc: (~y & x) == 0.
+			}
+			return scalar_is_subset_of(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		bool avx2_intersects(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				if (!_mm256_testz_si256(x, y)) return true;
+			}
+			return scalar_intersects(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		bool avx2_equals(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				__m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+				__m256i d = _mm256_xor_si256(x, y);
+				if (!_mm256_testz_si256(d, d)) return false;
+			}
+			return scalar_equals(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		bool avx2_none(block const * a, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				if (!_mm256_testz_si256(x, x)) return false;
+			}
+			return scalar_none(a + i, n - i);
+		}
+
+		DEL_TARGET("avx2")
+		std::size_t avx2_find_nonzero(block const * a, std::size_t from, std::size_t n)
+		{
+			std::size_t i = from;
+			for (; i + avx2_blocks <= n; i += avx2_blocks)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+				if (!_mm256_testz_si256(x, x)) break;
+			}
+			return scalar_find_nonzero(a, i, n);
+		}
+
+		/* AVX-512 foundation; count additionally needs VPOPCNTDQ. */
+
+#if defined(__GNUG__) && !defined(__clang__)
+		// Older GCC headers build some AVX-512 intrinsics from undefined vectors and then warn about them.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+		constexpr std::size_t avx512_blocks = sizeof(__m512i) / sizeof(block);
+
+		DEL_TARGET("avx512f")
+		void avx512_inplace_union(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				_mm512_storeu_si512(a + i, _mm512_or_si512(x, y));
+			}
+			scalar_inplace_union(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		void avx512_inplace_intersection(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				_mm512_storeu_si512(a + i, _mm512_and_si512(x, y));
+			}
+			scalar_inplace_intersection(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		void avx512_inplace_difference(block * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				_mm512_storeu_si512(a + i, _mm512_andnot_si512(y, x));
+			}
+			scalar_inplace_difference(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		bool avx512_is_subset_of(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				__m512i d = _mm512_andnot_si512(y, x);
+				if (_mm512_test_epi64_mask(d, d)) return false;
+			}
+			return scalar_is_subset_of(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		bool avx512_intersects(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				if (_mm512_test_epi64_mask(x, y)) return true;
+			}
+			return scalar_intersects(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		bool avx512_equals(block const * a, block const * b, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				__m512i y = _mm512_loadu_si512(b + i);
+				if (_mm512_cmpneq_epi64_mask(x, y)) return false;
+			}
+			return scalar_equals(a + i, b + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		bool avx512_none(block const * a, std::size_t n)
+		{
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				if (_mm512_test_epi64_mask(x, x)) return false;
+			}
+			return scalar_none(a + i, n - i);
+		}
+
+		DEL_TARGET("avx512f")
+		std::size_t avx512_find_nonzero(block const * a, std::size_t from, std::size_t n)
+		{
+			std::size_t i = from;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				__m512i x = _mm512_loadu_si512(a + i);
+				if (_mm512_test_epi64_mask(x, x)) break;
+			}
+			return scalar_find_nonzero(a, i, n);
+		}
+
+		DEL_TARGET("avx512f,avx512vpopcntdq,popcnt")
+		std::size_t avx512_count(block const * a, std::size_t n)
+		{
+			__m512i sum = _mm512_setzero_si512();
+			std::size_t i = 0;
+			for (; i + avx512_blocks <= n; i += avx512_blocks)
+			{
+				sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_loadu_si512(a + i)));
+			}
+			block lanes[avx512_blocks];
+			_mm512_storeu_si512(lanes, sum);
+			std::size_t result = 0;
+			for (block lane : lanes) result += lane;
+			for (; i < n; ++i)
+			{
+				result += static_cast<std::size_t>(_mm_popcnt_u64(a[i]));
+			}
+			return result;
+		}
+
+#if defined(__GNUG__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+		/* CPU feature detection. */
+
+		struct cpu_features
+		{
+			bool popcnt = false;
+			bool avx2 = false;
+			bool avx512f = false;
+			bool avx512vpopcntdq = false;
+		};
+
+		cpu_features detect_cpu_features()
+		{
+			cpu_features features;
+#if defined(_MSC_VER) && !defined(__clang__)
+			int regs[4];
+			__cpuid(regs, 0);
+			int max_leaf = regs[0];
+
+			__cpuid(regs, 1);
+			features.popcnt = (regs[2] >> 23) & 1;
+			bool osxsave = (regs[2] >> 27) & 1;
+			bool avx = (regs[2] >> 28) & 1;
+
+			// The OS must save the YMM (and for AVX-512 also the opmask and ZMM) registers on context switches.
+			unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+			bool os_ymm = (xcr0 & 0x6) == 0x6;
+			bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+
+			if (max_leaf >= 7)
+			{
+				__cpuidex(regs, 7, 0);
+				features.avx2 = avx && os_ymm && ((regs[1] >> 5) & 1);
+				features.avx512f = os_zmm && ((regs[1] >> 16) & 1);
+				features.avx512vpopcntdq = features.avx512f && ((regs[2] >> 14) & 1);
+			}
+#else
+			// Also checks that the OS saves the extended registers.
+			__builtin_cpu_init();
+			features.popcnt = __builtin_cpu_supports("popcnt");
+			features.avx2 = __builtin_cpu_supports("avx2");
+			features.avx512f = __builtin_cpu_supports("avx512f");
+			features.avx512vpopcntdq = features.avx512f && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+			return features;
+		}
+#endif
+
+		table select()
+		{
+			table t = scalar_table;
+#if DEL_KERNELS_X86_64
+			cpu_features features = detect_cpu_features();
+
+			t = { sse2_inplace_union, sse2_inplace_intersection, sse2_inplace_difference,
+				sse2_is_subset_of, sse2_intersects, sse2_equals, sse2_none,
+				scalar_count, sse2_find_nonzero,
+				"sse2" };
+			if (features.avx2)
+			{
+				t = { avx2_inplace_union, avx2_inplace_intersection, avx2_inplace_difference,
+					avx2_is_subset_of, avx2_intersects, avx2_equals, avx2_none,
+					scalar_count, avx2_find_nonzero,
+					"avx2" };
+			}
+			if (features.avx512f)
+			{
+				t = { avx512_inplace_union, avx512_inplace_intersection, avx512_inplace_difference,
+					avx512_is_subset_of, avx512_intersects, avx512_equals, avx512_none,
+					scalar_count, avx512_find_nonzero,
+					"avx512" };
+			}
+			if (features.avx512vpopcntdq && features.popcnt) t.count = avx512_count;
+			else if (features.popcnt) t.count = popcnt_count;
+#endif
+			return t;
+		}
+	}
+
+	table const & get()
+	{
+		static table const active = select();
+		return active;
+	}
+}
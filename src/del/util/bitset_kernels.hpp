@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace del::util::kernels
+{
+	/*
+		Bulk operations over arrays of n blocks, as used by bitset and bit_matrix for their default block type.
+		Each entry points to the widest implementation the running CPU supports (AVX-512, AVX2, SSE2 or scalar), selected once on first use.
+		The operations have the same meaning as the bitset member functions of the same name.
+	*/
+	struct table
+	{
+		void (*inplace_union)(std::size_t * a, std::size_t const * b, std::size_t n);
+		void (*inplace_intersection)(std::size_t * a, std::size_t const * b, std::size_t n);
+		void (*inplace_difference)(std::size_t * a, std::size_t const * b, std::size_t n);
+		bool (*is_subset_of)(std::size_t const * a, std::size_t const * b, std::size_t n);
+		bool (*intersects)(std::size_t const * a, std::size_t const * b, std::size_t n);
+		bool (*equals)(std::size_t const * a, std::size_t const * b, std::size_t n);
+		bool (*none)(std::size_t const * a, std::size_t n);
+		std::size_t (*count)(std::size_t const * a, std::size_t n);
+		// Index of the first non-zero block at or after 'from', or n if there is none.
+		std::size_t (*find_nonzero)(std::size_t const * a, std::size_t from, std::size_t n);
+
+		char const * name;
+	};
+
+	table const & get();
+
+	/*
+		Below this many blocks, the indirect call costs more than the wider instructions save, so callers keep their inline scalar loops.
+	*/
+	constexpr std::size_t min_blocks = 8;
+}
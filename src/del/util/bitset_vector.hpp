@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "del/util/bitset.hpp"
+
+
+namespace del::util
+{
+	/*
+		Growable sequence of bitsets of the same size, stored back to back and addressed by index; the growable counterpart of bitset_array.
+		Elements are accessed as bitset_span, which are invalidated when the vector grows, like iterators of std::vector.
+	*/
+	template<typename block_type = std::size_t>
+	class bitset_vector
+	{
+	public:
+		using common_state = bitset_common_state<block_type>;
+		using span = bitset_span<block_type>;
+		using const_span = bitset_span<block_type const>;
+
+		bitset_vector() = default;
+
+		bitset_vector(bitset_vector const &) = delete;
+		bitset_vector & operator=(bitset_vector const &) = delete;
+		bitset_vector(bitset_vector &&) noexcept = default;
+		bitset_vector & operator=(bitset_vector &&) noexcept = default;
+
+		~bitset_vector() = default;
+
+		std::size_t size() const
+		{
+			return this->count;
+		}
+
+		void reserve(common_state const & cs, std::size_t count)
+		{
+			this->blocks.reserve(count * cs.num_blocks);
+		}
+
+		// Appends an empty bitset and returns it.
+		span push_back(common_state const & cs)
+		{
+			++this->count;
+			this->blocks.resize(this->blocks.size() + cs.num_blocks, static_cast<block_type>(0));
+			return this->at(cs, this->count - 1);
+		}
+
+		void pop_back(common_state const & cs)
+		{
+			--this->count;
+			this->blocks.resize(this->blocks.size() - cs.num_blocks);
+		}
+
+		span at(common_state const & cs, std::size_t i)
+		{
+			return span(this->blocks.data() + i * cs.num_blocks);
+		}
+
+		const_span at(common_state const & cs, std::size_t i) const
+		{
+			return const_span(this->blocks.data() + i * cs.num_blocks);
+		}
+
+	private:
+		std::vector<block_type> blocks;
+		std::size_t count = 0;
+	};
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace del::util
+{
+	/*
+		Mixes value into seed, as boost::hash_combine does.
+	*/
+	inline void hash_combine(std::size_t & seed, std::size_t value)
+	{
+		seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+}
@@ -0,0 +1,29 @@
+#include "del/workspace.hpp"
+
+#include <stdexcept>
+
+
+namespace del
+{
+	util::bitset<> & workspace::acquire(size_type num_bits)
+	{
+		if (num_bits > this->capacity)
+		{
+			// Only regrow when nothing is handed out, as growing replaces all pooled bitsets.
+			if (this->used != 0) throw std::logic_error("workspace grown while its bitsets are in use");
+			this->bitsets.clear();
+			this->capacity = num_bits;
+		}
+
+		if (this->used == this->bitsets.size())
+		{
+			this->bitsets.emplace_back(util::bitset<>::common_state(this->capacity));
+		}
+		return this->bitsets[this->used++];
+	}
+
+	void workspace::release(size_type count)
+	{
+		this->used -= count;
+	}
+}
@@ -13,6 +13,132 @@
 */
 
 
+/*
+	Checks that the formula cache of a domain (see domain::set_formula_cache) answers as uncached evaluation does, and keeps the results of no more than capacity formulas per state.
+*/
+static bool check_formula_cache()
+{
+	using namespace del;
+
+	domain d({ "sally", "anne" }, { "marble_in_basket", "marble_in_box" }, { false, false });
+	d.set_formula_cache(2);
+	agent_id sally = d.get_agent_id("sally");
+	agent_id anne = d.get_agent_id("anne");
+	proposition_id basket = d.get_proposition_id("marble_in_basket");
+	proposition_id box = d.get_proposition_id("marble_in_box");
+
+	auto s0 = d.add_initial_state({ box, d.get_attention_proposition_id(sally, box), d.get_attention_proposition_id(anne, basket) });
+	auto [a1, s1] = d.perform_conscious_top_down(sally, { basket }, { box });
+	auto [a2, s2] = d.perform_do(anne, { box }, { basket });
+
+	formula & f = d.get_formulas();
+	std::vector<formula::node_id> queries = {
+		f.new_believes(sally, f.new_prop(basket)),
+		f.new_believes(anne, f.new_believes(sally, f.new_prop(box))),
+		f.new_common_belief({ sally, anne }, f.new_or({ f.new_prop(basket), f.new_prop(box) })),
+	};
+
+	for (state_id s : { s0, s1, s2 })
+	{
+		for (int round = 0; round < 3; ++round)
+		{
+			for (formula::node_id q : queries)
+			{
+				if (d.evaluate_formula(s, q) != f.evaluate(d.get_state(s), world_id{ 0 }, q, d.get_proposition_bitset_state())) return false;
+			}
+		}
+	}
+
+	// Queried in turn, three formulas never fit in two entries; after that, the two latest are kept and the oldest is not.
+	state const & s = d.get_state(s2);
+	if (s.get_formula_cache_hits() != 0 || s.get_formula_cache_misses() != 9) return false;
+	d.evaluate_formula(s2, queries[2]);
+	d.evaluate_formula(s2, queries[1]);
+	if (s.get_formula_cache_hits() != 2) return false;
+	d.evaluate_formula(s2, queries[0]);
+	return s.get_formula_cache_misses() == 10;
+}
+
+/*
+	Checks that bisimulation contraction (see domain::set_bisimulation_contraction) keeps what holds at the designated world, on the states of a run of the attention actions
+	performed once with contraction and once without: each contracted state answers a set of belief formulas as its uncontracted counterpart does, with no more worlds.
+*/
+static bool check_bisimulation_contraction()
+{
+	using namespace del;
+
+	std::vector<std::string> agents = { "sally", "anne" };
+	std::vector<std::string> propositions = { "marble_in_basket", "marble_in_box", "marble_in_table" };
+	domain contracted(agents, propositions, { false, false, false });
+	domain uncontracted(agents, propositions, { false, false, false });
+	uncontracted.set_bisimulation_contraction(false);
+
+	auto run = [&](domain & d)
+	{
+		agent_id sally = d.get_agent_id("sally");
+		agent_id anne = d.get_agent_id("anne");
+		proposition_id basket = d.get_proposition_id("marble_in_basket");
+		proposition_id box = d.get_proposition_id("marble_in_box");
+		proposition_id table = d.get_proposition_id("marble_in_table");
+
+		std::vector<state_id> states = { d.add_initial_state({ box, basket, d.get_attention_proposition_id(sally, box), d.get_attention_proposition_id(sally, table),
+			d.get_attention_proposition_id(anne, basket), d.get_attention_proposition_id(anne, box) }) };
+		states.push_back(d.perform_conscious_top_down(sally, { basket }, { box }).second);
+		states.push_back(d.perform_do(anne, { table }, { basket }).second);
+		states.push_back(d.perform_minimal_bottom_up({ anne }, { table }, {}).second);
+		states.push_back(d.perform_private_top_down(sally, {}, { basket }).second);
+		states.push_back(d.perform_do(sally, { basket }, { table }).second);
+		return states;
+	};
+
+	// The same formulas, built in the same order in the pool of each domain.
+	auto queries = [&](domain & d)
+	{
+		formula & f = d.get_formulas();
+		std::vector<agent_id> group = { d.get_agent_id("sally"), d.get_agent_id("anne") };
+		std::vector<formula::node_id> atoms;
+		for (auto & name : propositions)
+		{
+			proposition_id p = d.get_proposition_id(name);
+			atoms.push_back(f.new_prop(p));
+			for (agent_id a : group) atoms.push_back(f.new_prop(d.get_attention_proposition_id(a, p)));
+		}
+
+		std::vector<formula::node_id> qs;
+		for (formula::node_id atom : atoms)
+		{
+			for (formula::node_id g : { atom, f.new_not(atom) })
+			{
+				qs.push_back(g);
+				for (agent_id a : group)
+				{
+					qs.push_back(f.new_believes(a, g));
+					for (agent_id b : group) qs.push_back(f.new_believes(a, f.new_believes(b, g)));
+				}
+				qs.push_back(f.new_everyone_believes(group, 2, g));
+				qs.push_back(f.new_common_belief(group, g));
+			}
+		}
+		return qs;
+	};
+
+	std::vector<state_id> contracted_states = run(contracted);
+	std::vector<state_id> uncontracted_states = run(uncontracted);
+	std::vector<formula::node_id> contracted_queries = queries(contracted);
+	std::vector<formula::node_id> uncontracted_queries = queries(uncontracted);
+
+	for (std::size_t i = 0; i < contracted_states.size(); ++i)
+	{
+		if (contracted.get_state(contracted_states[i]).get_num_worlds() > uncontracted.get_state(uncontracted_states[i]).get_num_worlds()) return false;
+		for (std::size_t q = 0; q < contracted_queries.size(); ++q)
+		{
+			if (contracted.evaluate_formula(contracted_states[i], contracted_queries[q]) != uncontracted.evaluate_formula(uncontracted_states[i], uncontracted_queries[q])) return false;
+		}
+	}
+	return true;
+}
+
+
 int main(int argc, char* argv[])
 {
 	std::cout << "Hello world.\n\n";
@@ -81,7 +207,7 @@ int main(int argc, char* argv[])
 	auto s0 = d.add_initial_state({sally_attention_marble_in_basket,anne_attention_marble_in_box});
 	
 	// Formulas.
-	formula f;
+	formula & f = d.get_formulas(); // Shared with the actions of the domain.
 
 		// ** Attentiveness Test **
 	// Attentiveness states that if an agent pays attention to a specific atom,
@@ -664,6 +790,12 @@ int main(int argc, char* argv[])
 	std::cout<<"\n---------------------- State 4 ----------------------\n";
 	d.print_state_overview(d.get_state(s4), { sally_attention_marble_in_table, anne_attention_marble_in_table, sally_attention_marble_in_basket, anne_attention_marble_in_box, marble_in_basket, marble_in_box, marble_in_table  } );
 	*/
+	// Checks.
+	bool formula_cache_ok = check_formula_cache();
+	std::cout << "\nFormula cache check: " << (formula_cache_ok ? "passed" : "FAILED") << "\n";
+	bool contraction_ok = check_bisimulation_contraction();
+	std::cout << "\nBisimulation contraction check: " << (contraction_ok ? "passed" : "FAILED") << "\n";
+
 	// Done.
 
 	std::cout << "\n";